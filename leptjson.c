@@ -3,16 +3,530 @@
 #include <errno.h> /* errno */
 #include <math.h> /* HUGE_VAL */
 #include <string.h> /* memcpy */
+#include <inttypes.h> /* PRId64 */
+#include <pthread.h> /* pthread_mutex_t */
+#include <stdatomic.h> /* atomic_size_t */
+#include <fcntl.h> /* open */
+#include <unistd.h> /* close, sysconf */
+#include <sys/mman.h> /* mmap */
+#include <sys/stat.h> /* fstat */
+#ifdef __SSE2__
+#include <emmintrin.h> /* _mm_load_si128 */
+#endif
+#define LEPTJSON_IMPL
 #include "leptjson.h"
 
 
 int lept_parse(lept_value* v, const char* json) {
+    return lept_parse_json(v, json, LEPT_PARSE_DEFAULT, NULL);
+}
+
+int lept_parse_ex(lept_value* v, const char* json, int flags) {
+    return lept_parse_json(v, json, flags, NULL);
+}
+
+#define LEPT_BIND_SEED 0x13198A2E03707344ULL
+
+void lept_bind_prepare(lept_struct_desc* desc) {
+    size_t i;
+    assert(desc != NULL);
+    if (desc->prepared)
+        return;
+    for (i = 0; i < desc->field_count; i++) {
+        lept_field* f = &desc->fields[i];
+        f->hash = lept_hash_bytes(f->name, f->name_len, LEPT_BIND_SEED);
+        if (f->type == LEPT_FIELD_OBJECT)
+            lept_bind_prepare(f->desc);
+    }
+    desc->prepared = 1;
+}
+
+int lept_bind_parse(lept_struct_desc* desc, void* obj, const char* json) {
+    lept_content c;
+    int ret;
+    assert(desc != NULL && obj != NULL && json != NULL);
+    lept_bind_prepare(desc);
+    c.json = json;
+    c.stack = NULL;
+    c.size = c.top = 0;
+    c.flags = LEPT_PARSE_DEFAULT;
+    lept_parse_whitespace(&c);
+    if (*c.json == '{')
+        ret = lept_bind_object(&c, json + strlen(json), desc, (char*)obj);
+    else
+        ret = *c.json == '\0' ? LEPT_PARSE_EXPECT_VALUE : LEPT_PARSE_TYPE_MISMATCH;
+    if (ret == LEPT_PARSE_OK) {
+        lept_parse_whitespace(&c);
+        if (*c.json != '\0')
+            ret = LEPT_PARSE_ROOT_NOT_SINGULAR;
+    }
+    assert(c.top == 0);
+    free(c.stack);
+    return ret;
+}
+
+char* lept_bind_stringify(const lept_struct_desc* desc, const void* obj, size_t* length) {
+    lept_content c;
+    assert(desc != NULL && obj != NULL);
+    c.stack = NULL;
+    c.size = c.top = 0;
+    c.flags = LEPT_PARSE_DEFAULT;
+    if (lept_bind_write(&c, desc, (const char*)obj) != LEPT_PARSE_OK) {
+        free(c.stack);
+        if (length != NULL)
+            *length = 0;
+        return NULL;
+    }
+    if (length != NULL)
+        *length = c.top;
+    PUTC(&c, '\0');
+    return c.stack;
+}
+
+void lept_bind_free(const lept_struct_desc* desc, void* obj) {
+    size_t i;
+    assert(desc != NULL && obj != NULL);
+    for (i = 0; i < desc->field_count; i++) {
+        const lept_field* f = &desc->fields[i];
+        char* p = (char*)obj + f->offset;
+        if (f->type == LEPT_FIELD_STRING) {
+            free(*(char**)p);
+            *(char**)p = NULL;
+        }
+        else if (f->type == LEPT_FIELD_OBJECT)
+            lept_bind_free(f->desc, p);
+    }
+}
+
+// 游标状态
+enum { LEPT_CURSOR_FIRST, LEPT_CURSOR_NEXT, LEPT_CURSOR_DONE, LEPT_CURSOR_ERROR };
+
+int lept_array_cursor_open(lept_array_cursor* cur, const char* json, int flags) {
+    assert(cur != NULL && json != NULL);
+    memset(cur, 0, sizeof(*cur));
+    cur->json = json;
+    cur->end = json + strlen(json);
+    cur->eof = 1;
+    return lept_cursor_open(cur, flags);
+}
+
+int lept_array_cursor_open_file(lept_array_cursor* cur, const char* path, int flags) {
+    assert(cur != NULL && path != NULL);
+    memset(cur, 0, sizeof(*cur));
+    if ((cur->fp = fopen(path, "rb")) == NULL)
+        return lept_cursor_error(cur, LEPT_PARSE_FILE_ERROR);
+    cur->cap = LEPT_CURSOR_CHUNK;
+    cur->buf = (char*)malloc(cur->cap + 1);
+    cur->json = cur->end = cur->buf;
+    *cur->buf = '\0';
+    return lept_cursor_open(cur, flags);
+}
+
+int lept_array_cursor_next(lept_array_cursor* cur, lept_value* elem) {
+    int ret = LEPT_ARRAY_CURSOR_END;
+    assert(cur != NULL && elem != NULL);
+    lept_free(elem);
+    if (cur->state == LEPT_CURSOR_DONE)
+        return LEPT_ARRAY_CURSOR_END;
+    if (cur->state == LEPT_CURSOR_ERROR)
+        return cur->ret;
+    lept_cursor_whitespace(cur);
+    if (cur->state != LEPT_CURSOR_FIRST || *cur->json != ']') {
+        lept_cursor_ensure_value(cur);
+        cur->c.json = cur->json;
+        ret = lept_parse_value(&cur->c, elem);
+        cur->json = cur->c.json;
+        assert(cur->c.top == 0);
+        if (ret != LEPT_PARSE_OK)
+            return lept_cursor_error(cur, ret);
+        lept_cursor_whitespace(cur);
+        if (*cur->json == ',') {
+            cur->json++;
+            cur->state = LEPT_CURSOR_NEXT;
+            return LEPT_PARSE_OK;
+        }
+        if (*cur->json != ']') {
+            lept_free(elem);
+            return lept_cursor_error(cur, LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET);
+        }
+    }
+    // 遇到了结尾的']'，后面只能有空白
+    cur->json++;
+    lept_cursor_whitespace(cur);
+    if (cur->json != cur->end) {
+        lept_free(elem);
+        return lept_cursor_error(cur, LEPT_PARSE_ROOT_NOT_SINGULAR);
+    }
+    cur->state = LEPT_CURSOR_DONE;
+    return ret;
+}
+
+void lept_array_cursor_close(lept_array_cursor* cur) {
+    assert(cur != NULL);
+    if (cur->fp != NULL)
+        fclose(cur->fp);
+    free(cur->buf);
+    free(cur->c.stack);
+    memset(cur, 0, sizeof(*cur));
+}
+
+// 每个线程至少分到的元素数，元素太少时不值得开线程
+#ifndef LEPT_PARALLEL_MIN_ELEMENTS
+#define LEPT_PARALLEL_MIN_ELEMENTS 64
+#endif
+
+// 扫描时每隔这么多个元素记录一次位置，分段只能从记录过的位置开始，不能超过LEPT_PARALLEL_MIN_ELEMENTS
+#ifndef LEPT_PARALLEL_STRIDE
+#define LEPT_PARALLEL_STRIDE 16
+#endif
+
+int lept_parse_parallel(lept_value* v, const char* json, int flags, int threads) {
+    size_t len, count = 0, i, k, chunk, start, mark_size = 0;
+    const char* p;
+    const char* end;
+    const char** marks = NULL;
+    lept_parse_task* tasks;
+    pthread_t* tids;
+    lept_value* array;
+    int ok = 1;
+    assert(v != NULL && json != NULL);
+    len = strlen(json);
+    end = json + len;
+
+    // 只扫描一遍结构，统计顶层数组元素个数，同时每隔LEPT_PARALLEL_STRIDE个元素记录位置
+    p = json;
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+        p++;
+    if (threads <= 1 || *p != '[')
+        return lept_parse_ex(v, json, flags);
+    p++;
+    while (1) {
+        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+            p++;
+        if (count % LEPT_PARALLEL_STRIDE == 0) {
+            if (count / LEPT_PARALLEL_STRIDE == mark_size) {
+                mark_size += mark_size >> 1;
+                if (mark_size < 64)
+                    mark_size = 64;
+                marks = (const char**)realloc((void*)marks, mark_size * sizeof(const char*));
+            }
+            marks[count / LEPT_PARALLEL_STRIDE] = p;
+        }
+        if ((p = lept_skip_value(p, end)) == NULL)
+            break;
+        count++;
+        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+            p++;
+        if (*p == ',')
+            p++;
+        else if (*p == ']') {
+            for (p++; *p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'; p++);
+            break;
+        }
+        else {
+            p = NULL;
+            break;
+        }
+    }
+    if (p == NULL || *p != '\0' || count < (size_t)threads * LEPT_PARALLEL_MIN_ELEMENTS) {
+        free((void*)marks);
+        return lept_parse_ex(v, json, flags);
+    }
+    if (count > LEPT_SIZE_MAX) {
+        // 与串行解析相同，超出压缩布局的长度范围
+        free((void*)marks);
+        lept_init(v);
+        return LEPT_PARSE_TOO_LONG;
+    }
+
+    // 按元素个数大致均分，每段从记录过的位置开始
+    tasks = (lept_parse_task*)malloc(threads * sizeof(lept_parse_task));
+    tids = (pthread_t*)malloc(threads * sizeof(pthread_t));
+    array = (lept_value*)malloc(count * sizeof(lept_value));
+    chunk = count / threads;
+    for (k = 0; k < (size_t)threads; k++) {
+        start = k * chunk / LEPT_PARALLEL_STRIDE * LEPT_PARALLEL_STRIDE;
+        tasks[k].json = marks[start / LEPT_PARALLEL_STRIDE];
+        tasks[k].out = array + start;
+        tasks[k].flags = flags;
+        tasks[k].ret = LEPT_PARSE_OK;
+        tasks[k].started = 0;
+        if (k > 0)
+            tasks[k - 1].count = start - (size_t)(tasks[k - 1].out - array);
+    }
+    tasks[threads - 1].count = count - (size_t)(tasks[threads - 1].out - array);
+    free((void*)marks);
+    // 当前线程处理第一段，线程创建失败时也在当前线程处理
+    for (k = 1; k < (size_t)threads; k++)
+        tasks[k].started = pthread_create(&tids[k], NULL, lept_parse_task_run, &tasks[k]) == 0;
+    for (k = 0; k < (size_t)threads; k++)
+        if (!tasks[k].started)
+            lept_parse_task_run(&tasks[k]);
+    for (k = 1; k < (size_t)threads; k++)
+        if (tasks[k].started)
+            pthread_join(tids[k], NULL);
+    for (k = 0; k < (size_t)threads; k++)
+        ok = ok && tasks[k].ret == LEPT_PARSE_OK;
+    if (!ok) {
+        // 任务失败时已释放自己的结果，重新串行解析以得到相同的错误码
+        for (k = 0; k < (size_t)threads; k++)
+            if (tasks[k].ret == LEPT_PARSE_OK)
+                for (i = 0; i < tasks[k].count; i++)
+                    lept_free(&tasks[k].out[i]);
+        free(array);
+        free(tasks);
+        free(tids);
+        return lept_parse_ex(v, json, flags);
+    }
+    free(tasks);
+    free(tids);
+    lept_init(v);
+    v->array = array;
+    v->array_size = count;
+    v->type = LEPT_ARRAY;
+    v->packed = 0;
+    if (flags & LEPT_PARSE_PACK_NUMBERS) {
+        for (i = 0; i < count && array[i].type == LEPT_NUMBER; i++);
+        if (i == count) {
+            v->numbers = (double*)malloc(count * sizeof(double));
+            for (i = 0; i < count; i++)
+                v->numbers[i] = array[i].n;
+            v->packed = 1;
+            free(array);
+        }
+    }
+    return LEPT_PARSE_OK;
+}
+
+static int lept_map_file(const char* path, int flags, char** base, size_t* size, size_t* total) {
+    int fd;
+    struct stat st;
+    size_t page;
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return LEPT_PARSE_FILE_ERROR;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return LEPT_PARSE_FILE_ERROR;
+    }
+    *size = (size_t)st.st_size;
+    page = (size_t)sysconf(_SC_PAGESIZE);
+    // 多保留一页匿名映射，保证文件内容之后至少有一个'\0'
+    // 文件最后一页超出文件长度的部分由内核填0
+    *total = (*size + page - 1) / page * page + page;
+    *base = (char*)mmap(NULL, *total, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (*base == MAP_FAILED) {
+        close(fd);
+        return LEPT_PARSE_FILE_ERROR;
+    }
+    if (*size > 0) {
+        int mflags = MAP_PRIVATE | MAP_FIXED;
+#ifdef MAP_POPULATE
+        if (flags & LEPT_PARSE_FILE_POPULATE)
+            mflags |= MAP_POPULATE;
+#endif
+        if (mmap(*base, *size, PROT_READ, mflags, fd, 0) == MAP_FAILED) {
+            munmap(*base, *total);
+            close(fd);
+            return LEPT_PARSE_FILE_ERROR;
+        }
+        madvise(*base, *size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+    return LEPT_PARSE_OK;
+}
+
+int lept_parse_file(lept_value* v, const char* path, int flags) {
+    int ret;
+    size_t size, total;
+    char* base;
+    const char* end;
+    assert(v != NULL && path != NULL);
+    lept_init(v);
+    if ((ret = lept_map_file(path, flags, &base, &size, &total)) != LEPT_PARSE_OK)
+        return ret;
+    ret = lept_parse_json(v, base, flags, &end);
+    // 文件中间的'\0'会提前结束解析，视为根节点后还有值
+    if (ret == LEPT_PARSE_OK && end != base + size) {
+        lept_free(v);
+        ret = LEPT_PARSE_ROOT_NOT_SINGULAR;
+    }
+    munmap(base, total);
+    return ret;
+}
+
+int lept_validate(const char* json, size_t len, size_t* err_offset) {
+    int ret;
+    lept_validator c;
+    assert(json != NULL || len == 0);
+    c.json = json;
+    c.end = json + len;
+    lept_validate_whitespace(&c);
+    if ((ret = lept_validate_value(&c)) == LEPT_PARSE_OK) {
+        lept_validate_whitespace(&c);
+        // 与lept_parse_file一致，范围内的'\0'也算根节点后还有值
+        if (c.json != c.end)
+            ret = LEPT_PARSE_ROOT_NOT_SINGULAR;
+    }
+    if (ret != LEPT_PARSE_OK && err_offset != NULL)
+        *err_offset = (size_t)((c.json < c.end ? c.json : c.end) - json);
+    return ret;
+}
+
+int lept_reformat(const char* json, size_t len, int indent, lept_write_fn write, void* ctx) {
+    int ret;
+    char buf[LEPT_SINK_BUFFER_SIZE];
+    lept_validator c;
+    lept_sink s;
+    lept_content nest;
+    assert((json != NULL || len == 0) && indent >= 0 && write != NULL);
+    c.json = json;
+    c.end = json + len;
+    lept_sink_init(&s, buf, sizeof(buf), write, ctx);
+    // 只记录每一层是数组还是对象，占用随嵌套深度增长
+    nest.stack = NULL;
+    nest.size = nest.top = 0;
+    lept_validate_whitespace(&c);
+    if ((ret = lept_reformat_run(&c, &s, &nest, indent)) == LEPT_PARSE_OK) {
+        lept_validate_whitespace(&c);
+        if (c.json != c.end)
+            ret = LEPT_PARSE_ROOT_NOT_SINGULAR;
+    }
+    free(nest.stack);
+    lept_sink_flush(&s);
+    if (ret == LEPT_PARSE_OK && s.error)
+        ret = LEPT_PARSE_WRITE_ERROR;
+    return ret;
+}
+
+void lept_writer_init(lept_writer* w, char* buf, size_t size, lept_write_fn write, void* ctx) {
+    assert(w != NULL && buf != NULL && size >= 64 && write != NULL);
+    lept_sink_init(&w->sink, buf, size, write, ctx);
+    w->depth = 0;
+    w->first = 1;
+    w->after_key = 0;
+}
+
+void lept_writer_begin_object(lept_writer* w) {
+    lept_writer_begin(w, '{');
+}
+
+void lept_writer_end_object(lept_writer* w) {
+    assert(LEPT_WRITER_IN(w, '{') && !w->after_key);
+    w->depth--;
+    w->first = 0;
+    LEPT_SINK_PUTC(&w->sink, '}');
+}
+
+void lept_writer_begin_array(lept_writer* w) {
+    lept_writer_begin(w, '[');
+}
+
+void lept_writer_end_array(lept_writer* w) {
+    assert(LEPT_WRITER_IN(w, '['));
+    w->depth--;
+    w->first = 0;
+    LEPT_SINK_PUTC(&w->sink, ']');
+}
+
+void lept_writer_key(lept_writer* w, const char* key, size_t len) {
+    assert(LEPT_WRITER_IN(w, '{') && !w->after_key);
+    assert(key != NULL || len == 0);
+    if (!w->first)
+        LEPT_SINK_PUTC(&w->sink, ',');
+    lept_sink_string(&w->sink, key, len);
+    LEPT_SINK_PUTC(&w->sink, ':');
+    w->first = 0;
+    w->after_key = 1;
+}
+
+void lept_writer_string(lept_writer* w, const char* s, size_t len) {
+    assert(s != NULL || len == 0);
+    lept_writer_before_value(w);
+    lept_sink_string(&w->sink, s, len);
+}
+
+void lept_writer_number(lept_writer* w, double n) {
+    lept_writer_before_value(w);
+    lept_sink_number(&w->sink, n);
+}
+
+void lept_writer_int(lept_writer* w, int64_t n) {
+    char buf[32];
+    lept_writer_before_value(w);
+    lept_sink_write(&w->sink, buf, (size_t)sprintf(buf, "%" PRId64, n));
+}
+
+void lept_writer_boolean(lept_writer* w, int b) {
+    lept_writer_before_value(w);
+    if (b)
+        lept_sink_write(&w->sink, "true", 4);
+    else
+        lept_sink_write(&w->sink, "false", 5);
+}
+
+void lept_writer_null(lept_writer* w) {
+    lept_writer_before_value(w);
+    lept_sink_write(&w->sink, "null", 4);
+}
+
+void lept_writer_value(lept_writer* w, const lept_value* v) {
+    size_t i;
+    assert(v != NULL);
+    switch (v->type) {
+        case LEPT_NULL: lept_writer_null(w); break;
+        case LEPT_TRUE: lept_writer_boolean(w, 1); break;
+        case LEPT_FALSE: lept_writer_boolean(w, 0); break;
+        case LEPT_NUMBER: lept_writer_number(w, v->n); break;
+        case LEPT_STRING: lept_writer_string(w, v->s, v->len); break;
+        case LEPT_ARRAY:
+            lept_writer_begin_array(w);
+            for (i = 0; i < v->array_size; i++) {
+                if (v->packed)
+                    lept_writer_number(w, v->numbers[i]);
+                else
+                    lept_writer_value(w, &v->array[i]);
+            }
+            lept_writer_end_array(w);
+            break;
+        case LEPT_OBJECT:
+            lept_writer_begin_object(w);
+            for (i = 0; i < v->object_size; i++) {
+                lept_writer_key(w, v->object[i].key, v->object[i].key_len);
+                lept_writer_value(w, &v->object[i].v);
+            }
+            lept_writer_end_object(w);
+            break;
+        default: assert(0 && "invalid type");
+    }
+}
+
+int lept_writer_finish(lept_writer* w) {
+    // 必须正好写完一个完整的值
+    assert(w->depth == 0 && !w->first);
+    lept_sink_flush(&w->sink);
+    return w->sink.error ? w->sink.error : LEPT_PARSE_OK;
+}
+
+int lept_reformat_file(const char* path, int indent, lept_write_fn write, void* ctx) {
+    int ret;
+    size_t size, total;
+    char* base;
+    assert(path != NULL);
+    if ((ret = lept_map_file(path, LEPT_PARSE_DEFAULT, &base, &size, &total)) != LEPT_PARSE_OK)
+        return ret;
+    ret = lept_reformat(base, size, indent, write, ctx);
+    munmap(base, total);
+    return ret;
+}
+
+static int lept_parse_json(lept_value* v, const char* json, int flags, const char** end) {
     assert(v != NULL);
     int ret;
     lept_content c;
     c.json = json;
     c.stack = NULL;
     c.size = c.top = 0;
+    c.flags = flags;
     lept_init(v); // 默认类型为NULL,解析失败时为此值
 
     // 解析空白符号
@@ -27,6 +541,8 @@ int lept_parse(lept_value* v, const char* json) {
     // 确认清空缓冲区
     assert(c.top == 0);
     free(c.stack);
+    if (end != NULL)
+        *end = c.json;
     return ret;
 }
 
@@ -37,6 +553,10 @@ void lept_free(lept_value* v) {
             free(v->s);
             break;
         case LEPT_ARRAY: {
+            if (v->packed) {
+                free(v->numbers);
+                break;
+            }
             for (i = 0; i < v->array_size; i++) {
                 lept_free(&v->array[i]);
             }
@@ -46,7 +566,7 @@ void lept_free(lept_value* v) {
         case LEPT_OBJECT: {
             for (i = 0; i < lept_get_object_size(v); i++) {
                 free(v->object[i].key);
-                free(&v->object[i]);
+                lept_free(&v->object[i].v);
             }
             free(v->object);
             break;
@@ -96,6 +616,7 @@ size_t lept_get_string_length(const lept_value* v) {
 
 void lept_set_string(lept_value* v, const char* c, size_t len) {
     assert(v != NULL && (c != NULL || len == 0));
+    assert(len <= LEPT_SIZE_MAX);
     lept_free(v);
     v->s = (char*)malloc(len + 1);
     memcpy(v->s, c, len);
@@ -112,7 +633,32 @@ size_t lept_get_array_size(const lept_value* v) {
 lept_value* lept_get_array_element(const lept_value* v, size_t index) {
     assert(lept_get_type(v) == LEPT_ARRAY);
     assert(index < v->array_size);
-    return v->array + index;
+    // 紧凑存储的数组没有lept_value元素，只读的接口不能替调用者展开
+    assert(!v->packed);
+    return v->packed ? NULL : v->array + index;
+}
+
+double lept_get_array_number(const lept_value* v, size_t index) {
+    assert(lept_get_type(v) == LEPT_ARRAY);
+    assert(index < v->array_size);
+    if (v->packed)
+        return v->numbers[index];
+    return lept_get_number(&v->array[index]);
+}
+
+void lept_unpack_array(lept_value* v) {
+    assert(lept_get_type(v) == LEPT_ARRAY);
+    if (v->packed)
+        lept_array_unpack(v);
+}
+
+const double* lept_get_number_array(const lept_value* v, size_t* size) {
+    assert(lept_get_type(v) == LEPT_ARRAY);
+    if (!v->packed)
+        return NULL;
+    if (size != NULL)
+        *size = v->array_size;
+    return v->numbers;
 }
 
 size_t lept_get_object_size(const lept_value* v) {
@@ -138,90 +684,601 @@ lept_value* lept_get_object_value(const lept_value* v, size_t index) {
     return &v->object[index].v;
 }
 
-// !!注意下面代码是错误的，野指针，即使经常写代码也容易犯这种错误
-// 不要使用未初始化的指针
-// int lept_parse(lept_value* v, const char* json) {
-//     assert(v != NULL);
-//     lept_content* c;
-//     c->json = json;
-//     v->type = LEPT_NULL; // 默认类型为NULL,解析失败时为此值
-//
-//     // 解析空白符号
-//     lept_parse_whitespace(c);
-//     return lept_parse_value(c, v);
-// }
+size_t lept_find_object_index(const lept_value* v, const char* key, size_t klen) {
+    size_t i;
+    assert(lept_get_type(v) == LEPT_OBJECT && (key != NULL || klen == 0));
+    for (i = 0; i < v->object_size; i++)
+        if (v->object[i].key_len == klen && memcmp(v->object[i].key, key, klen) == 0)
+            return i;
+    return LEPT_KEY_NOT_EXIST;
+}
 
+lept_value* lept_find_object_value(const lept_value* v, const char* key, size_t klen) {
+    size_t index = lept_find_object_index(v, key, klen);
+    return index != LEPT_KEY_NOT_EXIST ? &v->object[index].v : NULL;
+}
 
-static void lept_parse_whitespace(lept_content* c) {
-    const char* p = c->json;
-    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
-        p++;
-    c->json = p;
+void lept_copy(lept_value* dst, const lept_value* src) {
+    size_t i;
+    assert(dst != NULL && src != NULL && dst != src);
+    switch (src->type) {
+        case LEPT_STRING:
+            lept_set_string(dst, src->s, src->len);
+            break;
+        case LEPT_ARRAY:
+            lept_set_container(dst, LEPT_ARRAY);
+            dst->array_size = src->array_size;
+            if (src->packed) {
+                dst->numbers = (double*)malloc(src->array_size * sizeof(double));
+                memcpy(dst->numbers, src->numbers, src->array_size * sizeof(double));
+                dst->packed = 1;
+                break;
+            }
+            dst->array = (lept_value*)malloc(src->array_size * sizeof(lept_value));
+            for (i = 0; i < src->array_size; i++) {
+                lept_init(&dst->array[i]);
+                lept_copy(&dst->array[i], &src->array[i]);
+            }
+            break;
+        case LEPT_OBJECT:
+            lept_set_container(dst, LEPT_OBJECT);
+            for (i = 0; i < src->object_size; i++)
+                lept_copy(lept_object_append(dst, src->object[i].key, src->object[i].key_len), &src->object[i].v);
+            break;
+        default:
+            lept_free(dst);
+            memcpy(dst, src, sizeof(lept_value));
+            break;
+    }
 }
 
-static int lept_parse_value(lept_content* c, lept_value* v) {
-    switch(*c->json) {
-        case 'n': return lept_parse_literal(c, v, "null", LEPT_NULL);
-        case 't': return lept_parse_literal(c, v, "true", LEPT_TRUE);
-        case 'f': return lept_parse_literal(c, v, "false", LEPT_FALSE);
-        case '\"': return lept_parse_string(c, v);
-        case '[': return lept_parse_array(c, v);
-        case '{': return lept_parse_object(c, v);
-        case '\0': return LEPT_PARSE_EXPECT_VALUE;
-        default: return lept_parse_number(c, v);
+void lept_move(lept_value* dst, lept_value* src) {
+    assert(dst != NULL && src != NULL && dst != src);
+    lept_free(dst);
+    memcpy(dst, src, sizeof(lept_value));
+    lept_init(src);
+}
+
+void lept_swap(lept_value* lhs, lept_value* rhs) {
+    lept_value temp;
+    assert(lhs != NULL && rhs != NULL);
+    if (lhs != rhs) {
+        memcpy(&temp, lhs, sizeof(lept_value));
+        memcpy(lhs, rhs, sizeof(lept_value));
+        memcpy(rhs, &temp, sizeof(lept_value));
     }
 }
 
-static int lept_parse_literal(lept_content* c, lept_value* v, const char* literal, lept_type type) {
-    EXPECT(c, literal[0]);
-    int index = 1;
-    while (literal[index] != '\0') {
-        if (c->json[index] != literal[index])
-            return LEPT_PARSE_INVALID_VALUE;
-        index++;
+// 对象成员数超过该值时，比较和哈希改用哈希索引查找键，避免O(n^2)的逐个匹配
+#ifndef LEPT_EQUAL_LINEAR_MAX
+#define LEPT_EQUAL_LINEAR_MAX 16
+#endif
+
+int lept_is_equal(const lept_value* lhs, const lept_value* rhs) {
+    lept_content scratch;
+    int ret;
+    assert(lhs != NULL && rhs != NULL);
+    scratch.stack = NULL;
+    scratch.size = scratch.top = 0;
+    ret = lept_is_equal_value(lhs, rhs, &scratch);
+    free(scratch.stack);
+    return ret;
+}
+
+uint64_t lept_hash(const lept_value* v) {
+    lept_content scratch;
+    uint64_t h;
+    assert(v != NULL);
+    scratch.stack = NULL;
+    scratch.size = scratch.top = 0;
+    h = lept_hash_value(v, &scratch);
+    free(scratch.stack);
+    return h;
+}
+
+static int lept_is_equal_value(const lept_value* lhs, const lept_value* rhs, lept_content* scratch) {
+    size_t i;
+    if (lhs->type != rhs->type)
+        return 0;
+    switch (lhs->type) {
+        case LEPT_NUMBER:
+            return lhs->n == rhs->n;
+        case LEPT_STRING:
+            return lhs->len == rhs->len && memcmp(lhs->s, rhs->s, lhs->len) == 0;
+        case LEPT_ARRAY:
+            if (lhs->array_size != rhs->array_size)
+                return 0;
+            if (lhs->packed || rhs->packed) {
+                // 紧凑数组只与同样全为数字的数组相等
+                double a, b;
+                for (i = 0; i < lhs->array_size; i++)
+                    if (!lept_array_number_at(lhs, i, &a) || !lept_array_number_at(rhs, i, &b) || a != b)
+                        return 0;
+                return 1;
+            }
+            for (i = 0; i < lhs->array_size; i++)
+                if (!lept_is_equal_value(&lhs->array[i], &rhs->array[i], scratch))
+                    return 0;
+            return 1;
+        case LEPT_OBJECT:
+            return lept_is_equal_object(lhs, rhs, scratch);
+        default:
+            return 1;
     }
-    c->json += index;
-    v->type = type;
-    return LEPT_PARSE_OK;
 }
 
-static int lept_parse_number(lept_content* c, lept_value* v) {
-    const char* p = c->json;
-    // check format
-    // 负号
-    if (*p == '-') 
-        p++;
-    // 数字
-    if (*p == '0') p++;
-    else {
-        if (!ISDIGIT0TO9(*p)) return LEPT_PARSE_INVALID_VALUE;
-        for (p++; ISDIGIT(*p); p++);
+static uint64_t lept_hash_value(const lept_value* v, lept_content* scratch) {
+    size_t i, mask, distinct, slots;
+    uint64_t h;
+    switch (v->type) {
+        case LEPT_NUMBER:
+            return lept_hash_number(v->n);
+        case LEPT_STRING:
+            return lept_hash_bytes(v->s, v->len, LEPT_HASH_SEED(LEPT_STRING));
+        case LEPT_ARRAY:
+            // 数组与元素顺序有关
+            h = LEPT_HASH_SEED(LEPT_ARRAY) ^ v->array_size;
+            for (i = 0; i < v->array_size; i++)
+                h = lept_hash_mix(h * LEPT_HASH_PRIME + (v->packed ? lept_hash_number(v->numbers[i]) : lept_hash_value(&v->array[i], scratch)));
+            return h;
+        case LEPT_OBJECT:
+            // 成员哈希相加，使结果与键的顺序无关，重复的键与lept_is_equal一样只算第一次出现
+            h = 0;
+            slots = lept_object_index(v, scratch, &mask, &distinct);
+            for (i = 0; i < v->object_size; i++) {
+                const lept_member* m = &v->object[i];
+                // 递归时scratch可能扩容，每次重新取索引的位置
+                if (lept_object_first(v, LEPT_SCRATCH_SLOTS(scratch, slots, mask), mask, m->key, m->key_len) == m)
+                    h += lept_hash_mix(lept_hash_bytes(m->key, m->key_len, LEPT_HASH_SEED(LEPT_OBJECT)) ^ lept_hash_value(&m->v, scratch) * LEPT_HASH_PRIME);
+            }
+            lept_object_index_free(scratch, mask);
+            return lept_hash_mix(h ^ LEPT_HASH_SEED(LEPT_OBJECT) ^ distinct);
+        default:
+            return lept_hash_mix(LEPT_HASH_SEED(v->type));
     }
-    // 小数
-    if (*p == '.') {
-        p++;
-        // 小数后面一个以上数字
-        if (!ISDIGIT(*p)) return LEPT_PARSE_INVALID_VALUE;
-        for (p++; ISDIGIT(*p); p++);
+}
+
+void lept_merge_patch(lept_value* target, lept_value* patch) {
+    size_t i, index;
+    assert(target != NULL && patch != NULL && target != patch);
+    if (patch->type != LEPT_OBJECT) {
+        lept_move(target, patch);
+        return;
     }
-    // 指数
-    if (*p == 'e' || *p == 'E') {
-        p++;
-        // 指数可能有正负
-        if (*p == '-' || *p == '+') p++;
-        // 后面是一个以上数字
-        if (!ISDIGIT(*p)) return LEPT_PARSE_INVALID_VALUE;
-        for (p++; ISDIGIT(*p); p++);
+    if (target->type != LEPT_OBJECT)
+        lept_set_container(target, LEPT_OBJECT);
+    for (i = 0; i < patch->object_size; i++) {
+        lept_member* m = &patch->object[i];
+        index = lept_find_object_index(target, m->key, m->key_len);
+        if (m->v.type == LEPT_NULL) {
+            if (index != LEPT_KEY_NOT_EXIST)
+                lept_object_remove(target, index);
+            continue;
+        }
+        // 新的键也要递归合并，以去掉嵌套对象中的null
+        lept_merge_patch(index != LEPT_KEY_NOT_EXIST ? &target->object[index].v : lept_object_append(target, m->key, m->key_len), &m->v);
     }
-
-    // 处理越界
-    errno = 0;
-    v->n = strtod(c->json, NULL);
-    if (errno == ERANGE && (v->n == HUGE_VAL || v->n == -HUGE_VAL))
-        return LEPT_PARSE_NUMBER_TOO_BIG;
-    c->json = p;
-    v->type = LEPT_NUMBER;
-    return LEPT_PARSE_OK;
+    lept_free(patch);
+}
+
+int lept_apply_patch(lept_value* target, lept_value* patch) {
+    size_t i;
+    int ret = LEPT_PATCH_OK;
+    assert(target != NULL && patch != NULL && target != patch);
+    if (patch->type != LEPT_ARRAY)
+        ret = LEPT_PATCH_INVALID;
+    else {
+        lept_content log;
+        log.stack = NULL;
+        log.size = log.top = 0;
+        lept_unpack_array(patch);
+        for (i = 0; i < patch->array_size && ret == LEPT_PATCH_OK; i++)
+            ret = lept_patch_op(target, &patch->array[i], &log);
+        if (ret != LEPT_PATCH_OK)
+            lept_patch_rollback(target, &log);
+        // 成功时丢弃被替换和移除的旧值
+        while (log.top > 0) {
+            lept_patch_undo* u = (lept_patch_undo*)lept_content_pop(&log, sizeof(lept_patch_undo));
+            free(u->key);
+            lept_free(&u->old);
+        }
+        free(log.stack);
+    }
+    lept_free(patch);
+    return ret;
+}
+
+void lept_diff(const lept_value* from, const lept_value* to, lept_value* patch) {
+    lept_content path, scratch;
+    assert(from != NULL && to != NULL && patch != NULL);
+    path.stack = scratch.stack = NULL;
+    path.size = path.top = scratch.size = scratch.top = 0;
+    lept_set_container(patch, LEPT_ARRAY);
+    lept_diff_value(&path, &scratch, from, to, patch);
+    free(path.stack);
+    free(scratch.stack);
+}
+
+void lept_shredder_init(lept_shredder* s, lept_column* columns, size_t column_count) {
+    size_t i, j;
+    assert(s != NULL && (columns != NULL || column_count == 0));
+    s->columns = columns;
+    s->column_count = column_count;
+    s->rows = s->capacity = 0;
+    for (i = 0; i < column_count; i++) {
+        lept_column* col = &columns[i];
+        assert(col->path != NULL && col->path[0] == '/');
+        col->path_len = strlen(col->path);
+        col->numbers = NULL;
+        col->chars = NULL;
+        col->chars_size = col->chars_cap = 0;
+        col->valid = NULL;
+        // 同一个值只能交给一列，路径相同或是前缀时后面的列永远匹配不到
+        for (j = 0; j < i; j++) {
+            const lept_column* other = &columns[j];
+            size_t n = col->path_len < other->path_len ? col->path_len : other->path_len;
+            assert(memcmp(col->path, other->path, n) != 0 || (col->path_len != other->path_len &&
+                (col->path_len > n ? col->path : other->path)[n] != '/'));
+        }
+    }
+    // 每层最多column_count个候选，每个候选是(列下标, 片段位置)
+    s->candidates = (size_t*)malloc((column_count + 1) * 2 * sizeof(size_t));
+    s->seen = (unsigned char*)malloc(column_count + 1);
+    s->c.stack = NULL;
+    s->c.size = s->c.top = 0;
+    s->c.flags = LEPT_PARSE_DEFAULT;
+}
+
+int lept_shred(lept_shredder* s, const char* json) {
+    const char* end;
+    int ret = LEPT_PARSE_OK;
+    assert(s != NULL && json != NULL);
+    end = json + strlen(json);
+    s->c.json = json;
+    lept_parse_whitespace(&s->c);
+    while (*s->c.json != '\0') {
+        if ((ret = lept_shred_record(s, end)) != LEPT_PARSE_OK)
+            break;
+        lept_parse_whitespace(&s->c);
+    }
+    assert(s->c.top == 0);
+    return ret;
+}
+
+void lept_shredder_clear(lept_shredder* s) {
+    size_t i;
+    assert(s != NULL);
+    s->rows = 0;
+    for (i = 0; i < s->column_count; i++)
+        s->columns[i].chars_size = 0;
+}
+
+void lept_shredder_free(lept_shredder* s) {
+    size_t i;
+    assert(s != NULL);
+    for (i = 0; i < s->column_count; i++) {
+        free(s->columns[i].numbers);
+        free(s->columns[i].chars);
+        free(s->columns[i].valid);
+        s->columns[i].numbers = NULL;
+        s->columns[i].chars = NULL;
+        s->columns[i].valid = NULL;
+    }
+    free(s->candidates);
+    free(s->seen);
+    free(s->c.stack);
+    s->candidates = NULL;
+    s->seen = NULL;
+    s->c.stack = NULL;
+    s->rows = s->capacity = 0;
+}
+
+// 整个文档的owner为NULL，树保存在v中
+// 子树句柄的owner指向整个文档，并持有它的一个引用
+struct lept_doc {
+    atomic_size_t ref;
+    const lept_value* root;
+    lept_doc* owner;
+    lept_value v;
+};
+
+lept_doc* lept_freeze(lept_value* v) {
+    lept_doc* doc = (lept_doc*)malloc(sizeof(lept_doc));
+    assert(v != NULL);
+    atomic_init(&doc->ref, 1);
+    doc->owner = NULL;
+    lept_init(&doc->v);
+    lept_move(&doc->v, v);
+    doc->root = &doc->v;
+    return doc;
+}
+
+const lept_value* lept_doc_root(const lept_doc* doc) {
+    assert(doc != NULL);
+    return doc->root;
+}
+
+lept_doc* lept_doc_retain(lept_doc* doc) {
+    assert(doc != NULL);
+    // 调用者已经持有一个引用，不需要同步
+    atomic_fetch_add_explicit(&doc->ref, 1, memory_order_relaxed);
+    return doc;
+}
+
+void lept_doc_release(lept_doc* doc) {
+    assert(doc != NULL);
+    if (atomic_fetch_sub(&doc->ref, 1) == 1)
+        lept_doc_free(doc);
+}
+
+lept_doc* lept_doc_subtree(lept_doc* doc, const lept_value* node) {
+    lept_doc* sub;
+    assert(doc != NULL && node != NULL);
+    if (node == doc->root)
+        return lept_doc_retain(doc);
+    sub = (lept_doc*)malloc(sizeof(lept_doc));
+    atomic_init(&sub->ref, 1);
+    sub->root = node;
+    sub->owner = lept_doc_retain(doc->owner != NULL ? doc->owner : doc);
+    lept_init(&sub->v);
+    return sub;
+}
+
+void lept_doc_thaw(lept_doc* doc, lept_value* v) {
+    lept_doc* owner;
+    assert(doc != NULL && v != NULL);
+    owner = doc->owner != NULL ? doc->owner : doc;
+    // 只有当前调用者持有整个文档时，别的线程不可能再取得引用
+    if (atomic_load(&doc->ref) == 1 && atomic_load(&owner->ref) == 1) {
+        lept_move(v, (lept_value*)doc->root);
+        lept_doc_release(doc);
+        return;
+    }
+    lept_copy(v, doc->root);
+    lept_doc_release(doc);
+}
+
+typedef struct lept_cache_entry lept_cache_entry;
+
+// 缓存条目，v必须是第一个成员，以便由lept_value*找回条目
+struct lept_cache_entry {
+    lept_value v;
+    atomic_size_t ref; // 引用计数，缓存自身持有一个
+    uint64_t hash;
+    char* json; // 输入的副本，用于排除哈希冲突
+    size_t len;
+    size_t memory;
+    lept_cache_entry* prev; // LRU链表，头部为最近使用
+    lept_cache_entry* next;
+    lept_cache_entry* chain; // 哈希桶链表
+};
+
+struct lept_cache {
+    pthread_mutex_t lock;
+    lept_cache_entry** buckets;
+    size_t bucket_mask;
+    lept_cache_entry* head;
+    lept_cache_entry* tail;
+    size_t max_entries, max_memory;
+    lept_cache_stats stats;
+};
+
+#define LEPT_CACHE_SEED 0x243F6A8885A308D3ULL
+
+static lept_cache_entry* lept_cache_lookup(lept_cache* cache, const char* json, size_t len, uint64_t h);
+static void lept_cache_touch(lept_cache* cache, lept_cache_entry* e);
+static void lept_cache_unlink(lept_cache* cache, lept_cache_entry* e);
+
+lept_cache* lept_cache_create(size_t max_entries, size_t max_memory) {
+    lept_cache* cache = (lept_cache*)calloc(1, sizeof(lept_cache));
+    size_t n = 16;
+    // 条目数不限时桶数取固定值
+    while (max_entries != 0 && n < max_entries)
+        n <<= 1;
+    if (max_entries == 0)
+        n = 1024;
+    cache->buckets = (lept_cache_entry**)calloc(n, sizeof(lept_cache_entry*));
+    cache->bucket_mask = n - 1;
+    cache->max_entries = max_entries;
+    cache->max_memory = max_memory;
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+void lept_cache_destroy(lept_cache* cache) {
+    lept_cache_entry* e = cache->head;
+    lept_cache_entry* next;
+    while (e != NULL) {
+        next = e->next;
+        lept_cache_release(&e->v);
+        e = next;
+    }
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->buckets);
+    free(cache);
+}
+
+const lept_value* lept_cache_parse(lept_cache* cache, const char* json, int* ret) {
+    size_t len;
+    uint64_t h;
+    lept_cache_entry* e;
+    lept_cache_entry** pp;
+    int status;
+    assert(cache != NULL && json != NULL);
+    len = strlen(json);
+    h = lept_hash_bytes(json, len, LEPT_CACHE_SEED);
+    pthread_mutex_lock(&cache->lock);
+    if ((e = lept_cache_lookup(cache, json, len, h)) != NULL) {
+        cache->stats.hits++;
+        lept_cache_touch(cache, e);
+        atomic_fetch_add(&e->ref, 1);
+        pthread_mutex_unlock(&cache->lock);
+        if (ret != NULL)
+            *ret = LEPT_PARSE_OK;
+        return &e->v;
+    }
+    cache->stats.misses++;
+    pthread_mutex_unlock(&cache->lock);
+
+    // 在锁外解析，避免阻塞其他线程的查找
+    e = (lept_cache_entry*)calloc(1, sizeof(lept_cache_entry));
+    if ((status = lept_parse(&e->v, json)) != LEPT_PARSE_OK) {
+        free(e);
+        if (ret != NULL)
+            *ret = status;
+        return NULL;
+    }
+    if (ret != NULL)
+        *ret = status;
+    atomic_init(&e->ref, 1);
+    e->hash = h;
+    e->len = len;
+    e->memory = sizeof(lept_cache_entry) + len + 1 + lept_value_memory(&e->v);
+    // 单个条目超过内存上限时不缓存，直接交给调用者
+    if (cache->max_memory != 0 && e->memory > cache->max_memory)
+        return &e->v;
+
+    pthread_mutex_lock(&cache->lock);
+    {
+        // 其他线程可能已经插入了相同的输入
+        lept_cache_entry* other = lept_cache_lookup(cache, json, len, h);
+        if (other != NULL) {
+            lept_cache_touch(cache, other);
+            atomic_fetch_add(&other->ref, 1);
+            pthread_mutex_unlock(&cache->lock);
+            lept_free(&e->v);
+            free(e);
+            return &other->v;
+        }
+    }
+    e->json = (char*)malloc(len + 1);
+    memcpy(e->json, json, len + 1);
+    atomic_fetch_add(&e->ref, 1);
+    pp = &cache->buckets[h & cache->bucket_mask];
+    e->chain = *pp;
+    *pp = e;
+    e->next = cache->head;
+    if (cache->head != NULL)
+        cache->head->prev = e;
+    else
+        cache->tail = e;
+    cache->head = e;
+    cache->stats.entries++;
+    cache->stats.memory += e->memory;
+    // 淘汰最久未使用的条目直到满足上限，新插入的条目位于头部不会被淘汰
+    while (cache->tail != e &&
+           ((cache->max_entries != 0 && cache->stats.entries > cache->max_entries) ||
+            (cache->max_memory != 0 && cache->stats.memory > cache->max_memory))) {
+        lept_cache_entry* victim = cache->tail;
+        lept_cache_unlink(cache, victim);
+        cache->stats.evictions++;
+        lept_cache_release(&victim->v);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return &e->v;
+}
+
+void lept_cache_release(const lept_value* v) {
+    lept_cache_entry* e = (lept_cache_entry*)v;
+    assert(v != NULL);
+    if (atomic_fetch_sub(&e->ref, 1) == 1) {
+        lept_free(&e->v);
+        free(e->json);
+        free(e);
+    }
+}
+
+void lept_cache_get_stats(lept_cache* cache, lept_cache_stats* stats) {
+    assert(cache != NULL && stats != NULL);
+    pthread_mutex_lock(&cache->lock);
+    *stats = cache->stats;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// !!注意下面代码是错误的，野指针，即使经常写代码也容易犯这种错误
+// 不要使用未初始化的指针
+// int lept_parse(lept_value* v, const char* json) {
+//     assert(v != NULL);
+//     lept_content* c;
+//     c->json = json;
+//     v->type = LEPT_NULL; // 默认类型为NULL,解析失败时为此值
+//
+//     // 解析空白符号
+//     lept_parse_whitespace(c);
+//     return lept_parse_value(c, v);
+// }
+
+
+static void lept_parse_whitespace(lept_content* c) {
+    const char* p = c->json;
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+        p++;
+    c->json = p;
+}
+
+static int lept_parse_value(lept_content* c, lept_value* v) {
+    switch(*c->json) {
+        case 'n': return lept_parse_literal(c, v, "null", LEPT_NULL);
+        case 't': return lept_parse_literal(c, v, "true", LEPT_TRUE);
+        case 'f': return lept_parse_literal(c, v, "false", LEPT_FALSE);
+        case '\"': return lept_parse_string(c, v);
+        case '[': return lept_parse_array(c, v);
+        case '{': return lept_parse_object(c, v);
+        case '\0': return LEPT_PARSE_EXPECT_VALUE;
+        default: return lept_parse_number(c, v);
+    }
+}
+
+static int lept_parse_literal(lept_content* c, lept_value* v, const char* literal, lept_type type) {
+    EXPECT(c, literal[0]);
+    int index = 1;
+    while (literal[index] != '\0') {
+        if (c->json[index] != literal[index])
+            return LEPT_PARSE_INVALID_VALUE;
+        index++;
+    }
+    c->json += index;
+    v->type = type;
+    return LEPT_PARSE_OK;
+}
+
+static int lept_parse_number(lept_content* c, lept_value* v) {
+    const char* p = c->json;
+    // check format
+    // 负号
+    if (*p == '-') 
+        p++;
+    // 数字
+    if (*p == '0') p++;
+    else {
+        if (!ISDIGIT0TO9(*p)) return LEPT_PARSE_INVALID_VALUE;
+        for (p++; ISDIGIT(*p); p++);
+    }
+    // 小数
+    if (*p == '.') {
+        p++;
+        // 小数后面一个以上数字
+        if (!ISDIGIT(*p)) return LEPT_PARSE_INVALID_VALUE;
+        for (p++; ISDIGIT(*p); p++);
+    }
+    // 指数
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        // 指数可能有正负
+        if (*p == '-' || *p == '+') p++;
+        // 后面是一个以上数字
+        if (!ISDIGIT(*p)) return LEPT_PARSE_INVALID_VALUE;
+        for (p++; ISDIGIT(*p); p++);
+    }
+
+    // 处理越界
+    errno = 0;
+    v->n = strtod(c->json, NULL);
+    if (errno == ERANGE && (v->n == HUGE_VAL || v->n == -HUGE_VAL))
+        return LEPT_PARSE_NUMBER_TOO_BIG;
+    c->json = p;
+    v->type = LEPT_NUMBER;
+    return LEPT_PARSE_OK;
 }
 
 #define STRING_ERROR(error) do { c->top = old_top; return error; } while (0)
@@ -231,11 +1288,20 @@ static int lept_parse_string_raw(lept_content* c, char** str, size_t* size) {
     const char* p = c->json;
     p++;
     size_t old_top = c->top;
+    size_t n;
+    int strict = c->flags & LEPT_PARSE_VALIDATE_UTF8;
     while (1) {
+        // 成块复制普通字符
+        if ((n = lept_scan_string_plain(p, strict)) != 0) {
+            memcpy(lept_content_push(c, n), p, n);
+            p += n;
+        }
         char ch = *p++;
         switch(ch) {
             case '\"':
                 *size = c->top - old_top;
+                if (*size > LEPT_SIZE_MAX)
+                    STRING_ERROR(LEPT_PARSE_TOO_LONG);
                 *str = (char*)lept_content_pop(c, *size);
                 c->json = p;
                 return LEPT_PARSE_OK;
@@ -292,11 +1358,85 @@ static int lept_parse_string_raw(lept_content* c, char** str, size_t* size) {
             default:
                 if ((unsigned char)ch < 0x20) 
                     STRING_ERROR(LEPT_PARSE_INVALID_STRING_CHAR);
+                if ((unsigned char)ch >= 0x80 && strict) {
+                    if ((n = lept_utf8_sequence((const unsigned char*)p - 1)) == 0)
+                        STRING_ERROR(LEPT_PARSE_INVALID_UTF8);
+                    memcpy(lept_content_push(c, n), p - 1, n);
+                    p += n - 1;
+                    break;
+                }
                 PUTC(c, ch);
         }
     }
 }
 
+// 按16字节对齐的块读取，对齐的读取不会跨页，读到字符串结尾之后也是安全的
+// 这种越界读取对AddressSanitizer不可见
+#if defined(__SANITIZE_ADDRESS__)
+#define LEPT_NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#else
+#define LEPT_NO_SANITIZE_ADDRESS
+#endif
+
+LEPT_NO_SANITIZE_ADDRESS
+static size_t lept_scan_string_plain(const char* p, int strict) {
+#ifdef __SSE2__
+    const char* start = p;
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+    if (((uintptr_t)p & 15) != 0)
+        return 0;
+    while (1) {
+        __m128i chunk = _mm_load_si128((const __m128i*)p);
+        __m128i special = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash));
+        // 无符号比较 chunk <= 0x1F，包括结尾的'\0'
+        special = _mm_or_si128(special, _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk));
+        unsigned mask = (unsigned)_mm_movemask_epi8(special);
+        // 严格模式下非ASCII字节交给逐字节校验
+        if (strict)
+            mask |= (unsigned)_mm_movemask_epi8(chunk);
+        if (mask != 0)
+            return (size_t)(p - start) + (size_t)__builtin_ctz(mask);
+        p += 16;
+    }
+#else
+    (void)p;
+    (void)strict;
+    return 0;
+#endif
+}
+
+// 以首字节为下标(减去0xC0)：序列长度，以及第二个字节的取值范围
+// 其余字节的范围都是0x80~0xBF，排除了过长编码、代理区和超过0x10FFFF的码点
+static const struct {
+    unsigned char len, lo, hi;
+} lept_utf8_lead[64] = {
+    {0, 0, 0}, {0, 0, 0}, {2, 0x80, 0xBF}, {2, 0x80, 0xBF}, {2, 0x80, 0xBF}, {2, 0x80, 0xBF}, {2, 0x80, 0xBF}, {2, 0x80, 0xBF},
+    {2, 0x80, 0xBF}, {2, 0x80, 0xBF}, {2, 0x80, 0xBF}, {2, 0x80, 0xBF}, {2, 0x80, 0xBF}, {2, 0x80, 0xBF}, {2, 0x80, 0xBF}, {2, 0x80, 0xBF},
+    {2, 0x80, 0xBF}, {2, 0x80, 0xBF}, {2, 0x80, 0xBF}, {2, 0x80, 0xBF}, {2, 0x80, 0xBF}, {2, 0x80, 0xBF}, {2, 0x80, 0xBF}, {2, 0x80, 0xBF},
+    {2, 0x80, 0xBF}, {2, 0x80, 0xBF}, {2, 0x80, 0xBF}, {2, 0x80, 0xBF}, {2, 0x80, 0xBF}, {2, 0x80, 0xBF}, {2, 0x80, 0xBF}, {2, 0x80, 0xBF},
+    {3, 0xA0, 0xBF}, {3, 0x80, 0xBF}, {3, 0x80, 0xBF}, {3, 0x80, 0xBF}, {3, 0x80, 0xBF}, {3, 0x80, 0xBF}, {3, 0x80, 0xBF}, {3, 0x80, 0xBF},
+    {3, 0x80, 0xBF}, {3, 0x80, 0xBF}, {3, 0x80, 0xBF}, {3, 0x80, 0xBF}, {3, 0x80, 0xBF}, {3, 0x80, 0x9F}, {3, 0x80, 0xBF}, {3, 0x80, 0xBF},
+    {4, 0x90, 0xBF}, {4, 0x80, 0xBF}, {4, 0x80, 0xBF}, {4, 0x80, 0xBF}, {4, 0x80, 0x8F}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0},
+    {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}
+};
+
+static size_t lept_utf8_sequence(const unsigned char* p) {
+    size_t i, len;
+    // 0x80~0xBF是单独出现的后续字节
+    if (p[0] < 0xC0)
+        return 0;
+    len = lept_utf8_lead[p[0] - 0xC0].len;
+    if (len == 0 || p[1] < lept_utf8_lead[p[0] - 0xC0].lo || p[1] > lept_utf8_lead[p[0] - 0xC0].hi)
+        return 0;
+    // 遇到'\0'时在这里返回，不会越过字符串结尾
+    for (i = 2; i < len; i++)
+        if (p[i] < 0x80 || p[i] > 0xBF)
+            return 0;
+    return len;
+}
+
 static int lept_parse_string(lept_content* c, lept_value* v) {
     int ret;
     char* ch;
@@ -377,6 +1517,7 @@ static int lept_parse_array(lept_content* c, lept_value* v) {
         v->array = NULL;
         v->array_size = size;
         v->type = LEPT_ARRAY;
+        v->packed = 0;
         return LEPT_PARSE_OK;
     }
     while (1) {
@@ -387,6 +1528,10 @@ static int lept_parse_array(lept_content* c, lept_value* v) {
         // 解析成功，将该lept_value存入c的缓存区中
         memcpy(lept_content_push(c, sizeof(lept_value)), &e, sizeof(lept_value));
         size++; // 数组大小增加
+        if (size > LEPT_SIZE_MAX) {
+            ret = LEPT_PARSE_TOO_LONG;
+            break;
+        }
         lept_parse_whitespace(c);
         if (*c->json == ',') { // 逗号，后面还有项
             c->json++;
@@ -395,9 +1540,12 @@ static int lept_parse_array(lept_content* c, lept_value* v) {
         else if (*c->json == ']') {
             c->json++;
             v->array_size = size;
+            v->type = LEPT_ARRAY;
+            v->packed = 0;
+            if ((c->flags & LEPT_PARSE_PACK_NUMBERS) && lept_pack_numbers(c, v))
+                return LEPT_PARSE_OK;
             size *= sizeof(lept_value);
             memcpy((v->array = (lept_value*)malloc(size)), lept_content_pop(c, size), size);
-            v->type = LEPT_ARRAY;
             return LEPT_PARSE_OK;
         }
         else {
@@ -411,77 +1559,1806 @@ static int lept_parse_array(lept_content* c, lept_value* v) {
     return ret;
 }
 
-static int lept_parse_object(lept_content* c, lept_value* v) {
-    size_t size = 0, i;
+static int lept_bind_object(lept_content* c, const char* end, lept_struct_desc* desc, char* obj) {
+    size_t i, key_len;
+    uint64_t h;
+    char* key;
     int ret;
-    lept_member m;
-    lept_member* release;
+    const lept_field* f;
     EXPECT(c, '{');
     c->json++;
     lept_parse_whitespace(c);
     if (*c->json == '}') {
         c->json++;
-        v->object_size = 0;
-        v->object = NULL;
-        v->type = LEPT_OBJECT;
         return LEPT_PARSE_OK;
     }
     while (1) {
-        // 初始化lept_member
-        m.key = NULL;
-        m.key_len = 0;
-        lept_init(&m.v);
-        char* tmp;
-        if (*c->json != '\"') {
-            ret = LEPT_PARSE_MISS_KEY;
-            break;
-        }
-        if ((ret = lept_parse_string_raw(c, &tmp, &m.key_len)) != LEPT_PARSE_OK)
-            break;
-        // 键解析成功， 给m的键分配内存
-        m.key = (char*)malloc(m.key_len + 1);
-        memcpy(m.key, tmp, m.key_len);
-        m.key[m.key_len] = '\0';
+        if (*c->json != '\"')
+            return LEPT_PARSE_MISS_KEY;
+        // 键解码在解析栈上，用完立即出栈，不分配内存
+        if ((ret = lept_parse_string_raw(c, &key, &key_len)) != LEPT_PARSE_OK)
+            return ret;
+        h = lept_hash_bytes(key, key_len, LEPT_BIND_SEED);
+        for (i = 0, f = NULL; i < desc->field_count; i++)
+            if (desc->fields[i].hash == h && desc->fields[i].name_len == key_len &&
+                memcmp(desc->fields[i].name, key, key_len) == 0) {
+                f = &desc->fields[i];
+                break;
+            }
         lept_parse_whitespace(c);
-        if (*c->json == ':') {
-            c->json++;
-            lept_parse_whitespace(c);
-        }
+        if (*c->json != ':')
+            return LEPT_PARSE_MISS_COLON;
+        c->json++;
+        lept_parse_whitespace(c);
+        if (f != NULL)
+            ret = lept_bind_field(c, end, f, obj);
         else {
-            ret = LEPT_PARSE_MISS_COLON;
-            free(m.key);
-            break;
-        }
-        if ((ret = lept_parse_value(c, &m.v)) != LEPT_PARSE_OK) {
-            free(m.key);
-            break;
+            // 未知的键：只校验并跳过它的值
+            lept_validator v;
+            v.json = c->json;
+            v.end = end;
+            ret = lept_validate_value(&v);
+            c->json = v.json;
         }
-        // 值解析成功
-        memcpy(lept_content_push(c, sizeof(lept_member)), &m, sizeof(lept_member));
-        size++;
+        if (ret != LEPT_PARSE_OK)
+            return ret;
         lept_parse_whitespace(c);
-        // 下一个键值对
         if (*c->json == ',') {
             c->json++;
             lept_parse_whitespace(c);
         }
         else if (*c->json == '}') {
             c->json++;
-            v->object_size = size;
-            size *= sizeof(lept_member);
-            memcpy(v->object = (lept_member*)malloc(size), lept_content_pop(c, size), size);
-            v->type = LEPT_OBJECT;
             return LEPT_PARSE_OK;
         }
-        else {
-            ret = LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+        else
+            return LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+    }
+}
+
+static int lept_bind_field(lept_content* c, const char* end, const lept_field* f, char* obj) {
+    lept_value e;
+    int ret;
+    char* p = obj + f->offset;
+    if (*c->json == '{' && f->type == LEPT_FIELD_OBJECT)
+        return lept_bind_object(c, end, f->desc, p);
+    if (*c->json == '{' || *c->json == '[')
+        return LEPT_PARSE_TYPE_MISMATCH;
+    if (f->type == LEPT_FIELD_INT && (*c->json == '-' || ISDIGIT(*c->json)))
+        return lept_parse_int64(c, (int64_t*)p);
+    // 标量直接解析，字符串的内存转交给字段
+    lept_init(&e);
+    if ((ret = lept_parse_value(c, &e)) != LEPT_PARSE_OK)
+        return ret;
+    if (e.type == LEPT_NULL)
+        return LEPT_PARSE_OK;
+    switch (f->type) {
+        case LEPT_FIELD_NUMBER:
+            if (e.type != LEPT_NUMBER)
+                break;
+            *(double*)p = e.n;
+            return LEPT_PARSE_OK;
+        case LEPT_FIELD_BOOL:
+            if (e.type != LEPT_TRUE && e.type != LEPT_FALSE)
+                break;
+            *(int*)p = e.type == LEPT_TRUE;
+            return LEPT_PARSE_OK;
+        case LEPT_FIELD_STRING:
+            if (e.type != LEPT_STRING)
+                break;
+            free(*(char**)p);
+            *(char**)p = e.s;
+            return LEPT_PARSE_OK;
+        default:
             break;
+    }
+    lept_free(&e);
+    return LEPT_PARSE_TYPE_MISMATCH;
+}
+
+static int lept_parse_int64(lept_content* c, int64_t* out) {
+    const char* p = c->json;
+    int neg = *p == '-';
+    uint64_t u = 0, limit = (uint64_t)INT64_MAX + neg;
+    int overflow = 0;
+    lept_value e;
+    int ret;
+    // 纯整数边扫描边累加，不经过strtod，也不经过double以免丢失精度
+    p += neg;
+    if (*p == '0') p++;
+    else {
+        if (!ISDIGIT0TO9(*p)) return LEPT_PARSE_INVALID_VALUE;
+        for (; ISDIGIT(*p); p++) {
+            unsigned d = (unsigned)(*p - '0');
+            if (u > (limit - d) / 10)
+                overflow = 1;
+            else
+                u = u * 10 + d;
         }
     }
-    // 解析失败，释放之前的内存
-    for (i = 0; i < size; i++) {
-        release = (lept_member*)lept_content_pop(c, sizeof(lept_member));
-        free(release->key);
+    if (*p != '.' && *p != 'e' && *p != 'E') {
+        if (overflow)
+            return LEPT_PARSE_TYPE_MISMATCH;
+        *out = neg ? (u > (uint64_t)INT64_MAX ? INT64_MIN : -(int64_t)u) : (int64_t)u;
+        c->json = p;
+        return LEPT_PARSE_OK;
     }
-    return ret;
+    // 1.0、1e3这样写法的整数
+    if ((ret = lept_parse_number(c, &e)) != LEPT_PARSE_OK)
+        return ret;
+    if (e.n < -9223372036854775808.0 || e.n >= 9223372036854775808.0 || e.n != (double)(int64_t)e.n)
+        return LEPT_PARSE_TYPE_MISMATCH;
+    *out = (int64_t)e.n;
+    return LEPT_PARSE_OK;
+}
+
+static int lept_bind_write(lept_content* c, const lept_struct_desc* desc, const char* obj) {
+    size_t i;
+    char buf[32];
+    int ret;
+    PUTC(c, '{');
+    for (i = 0; i < desc->field_count; i++) {
+        const lept_field* f = &desc->fields[i];
+        const char* p = obj + f->offset;
+        if (i > 0)
+            PUTC(c, ',');
+        lept_stringify_string(c, f->name, f->name_len);
+        PUTC(c, ':');
+        switch (f->type) {
+            case LEPT_FIELD_NUMBER:
+                // 与lept_writer_number相同，NaN和无穷大无法写成JSON
+                if (!isfinite(*(const double*)p))
+                    return LEPT_PARSE_NOT_FINITE;
+                lept_stringify_number(c, *(const double*)p);
+                break;
+            case LEPT_FIELD_INT:
+                PUTS(c, buf, (size_t)sprintf(buf, "%" PRId64, *(const int64_t*)p));
+                break;
+            case LEPT_FIELD_BOOL:
+                if (*(const int*)p)
+                    PUTS(c, "true", 4);
+                else
+                    PUTS(c, "false", 5);
+                break;
+            case LEPT_FIELD_STRING:
+                if (*(char* const*)p != NULL)
+                    lept_stringify_string(c, *(char* const*)p, strlen(*(char* const*)p));
+                else
+                    PUTS(c, "null", 4);
+                break;
+            case LEPT_FIELD_OBJECT:
+                if ((ret = lept_bind_write(c, f->desc, p)) != LEPT_PARSE_OK)
+                    return ret;
+                break;
+        }
+    }
+    PUTC(c, '}');
+    return LEPT_PARSE_OK;
+}
+
+static void lept_stringify_string(lept_content* c, const char* s, size_t len) {
+    // 每个字符最多转义为6个字符，先一次性预留空间
+    char* head = (char*)lept_content_push(c, len * 6 + 2);
+    size_t n = lept_escape_string(head + 1, s, len);
+    head[0] = head[n + 1] = '\"';
+    // 归还多预留的空间
+    c->top -= len * 6 - n;
+}
+
+static size_t lept_escape_string(char* out, const char* s, size_t len) {
+    static const char hex[] = "0123456789ABCDEF";
+    size_t i = 0, n;
+    char* p = out;
+    while (i < len) {
+        // 不需要转义的部分整段复制
+        n = lept_scan_string_plain_n(s + i, len - i);
+        memcpy(p, s + i, n);
+        p += n;
+        if ((i += n) == len)
+            break;
+        switch (s[i]) {
+            case '\"': *p++ = '\\'; *p++ = '\"'; break;
+            case '\\': *p++ = '\\'; *p++ = '\\'; break;
+            case '\b': *p++ = '\\'; *p++ = 'b'; break;
+            case '\f': *p++ = '\\'; *p++ = 'f'; break;
+            case '\n': *p++ = '\\'; *p++ = 'n'; break;
+            case '\r': *p++ = '\\'; *p++ = 'r'; break;
+            case '\t': *p++ = '\\'; *p++ = 't'; break;
+            default:
+                *p++ = '\\'; *p++ = 'u'; *p++ = '0'; *p++ = '0';
+                *p++ = hex[(unsigned char)s[i] >> 4];
+                *p++ = hex[s[i] & 15];
+        }
+        i++;
+    }
+    return (size_t)(p - out);
+}
+
+static void lept_stringify_number(lept_content* c, double n) {
+    char buf[32];
+    assert(isfinite(n));
+    PUTS(c, buf, lept_format_number(buf, n));
+}
+
+static size_t lept_format_number(char* buf, double n) {
+    return (size_t)sprintf(buf, "%.17g", n);
+}
+
+static int lept_cursor_open(lept_array_cursor* cur, int flags) {
+    cur->c.flags = flags;
+    lept_cursor_whitespace(cur);
+    if (*cur->json == '[') {
+        cur->json++;
+        cur->state = LEPT_CURSOR_FIRST;
+        return LEPT_PARSE_OK;
+    }
+    return lept_cursor_error(cur, cur->json == cur->end ? LEPT_PARSE_EXPECT_VALUE : LEPT_PARSE_NOT_ARRAY);
+}
+
+static int lept_cursor_error(lept_array_cursor* cur, int ret) {
+    cur->state = LEPT_CURSOR_ERROR;
+    return cur->ret = ret;
+}
+
+static int lept_cursor_fill(lept_array_cursor* cur) {
+    size_t used, n;
+    if (cur->eof)
+        return 0;
+    // 把未处理的数据移到窗口开头，窗口已满时扩大一倍
+    used = (size_t)(cur->end - cur->json);
+    memmove(cur->buf, cur->json, used);
+    if (used == cur->cap) {
+        cur->cap *= 2;
+        cur->buf = (char*)realloc(cur->buf, cur->cap + 1);
+    }
+    n = fread(cur->buf + used, 1, cur->cap - used, cur->fp);
+    if (n == 0)
+        cur->eof = 1;
+    cur->json = cur->buf;
+    cur->end = cur->buf + used + n;
+    *(char*)cur->end = '\0';
+    return n != 0;
+}
+
+static void lept_cursor_whitespace(lept_array_cursor* cur) {
+    do {
+        while (*cur->json == ' ' || *cur->json == '\t' || *cur->json == '\n' || *cur->json == '\r')
+            cur->json++;
+    } while (cur->json == cur->end && lept_cursor_fill(cur));
+}
+
+static void lept_cursor_ensure_value(lept_array_cursor* cur) {
+    const char* p;
+    if (cur->fp == NULL)
+        return;
+    while (1) {
+        // 值正好结束在窗口末尾时，数字等可能还没有读完，也需要继续读入
+        if ((p = lept_skip_value(cur->json, cur->end)) != NULL && p != cur->end) {
+            while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+                p++;
+            if (p != cur->end)
+                return;
+        }
+        if (!lept_cursor_fill(cur))
+            return;
+    }
+}
+
+static const char* lept_skip_value(const char* p, const char* end) {
+    size_t depth = 0;
+    while (p < end) {
+        switch (*p) {
+            case '\"':
+                // 跳过字符串，反斜杠后面的字符不作处理
+                for (p++; p < end && *p != '\"'; p++)
+                    if (*p == '\\' && ++p == end)
+                        return NULL;
+                if (p == end)
+                    return NULL;
+                p++;
+                if (depth == 0)
+                    return p;
+                break;
+            case '[': case '{':
+                depth++;
+                p++;
+                break;
+            case ']': case '}':
+                // 不成对的右括号留给解析时报错
+                if (depth == 0)
+                    return p;
+                p++;
+                if (--depth == 0)
+                    return p;
+                break;
+            case ',': case ' ': case '\t': case '\n': case '\r':
+                if (depth == 0)
+                    return p;
+                p++;
+                break;
+            default:
+                p++;
+        }
+    }
+    return depth == 0 ? p : NULL;
+}
+
+static void* lept_parse_task_run(void* arg) {
+    lept_parse_task* task = (lept_parse_task*)arg;
+    lept_content c;
+    size_t i;
+    c.json = task->json;
+    c.stack = NULL;
+    c.size = c.top = 0;
+    c.flags = task->flags;
+    for (i = 0; i < task->count; i++) {
+        lept_init(&task->out[i]);
+        if ((task->ret = lept_parse_value(&c, &task->out[i])) == LEPT_PARSE_OK) {
+            lept_parse_whitespace(&c);
+            // 元素后面必须是','或者结尾的']'，与第一遍扫描的划分一致
+            if (*c.json != ',' && *c.json != ']')
+                task->ret = LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+            else {
+                c.json++;
+                lept_parse_whitespace(&c);
+                continue;
+            }
+            lept_free(&task->out[i]);
+        }
+        while (i > 0)
+            lept_free(&task->out[--i]);
+        break;
+    }
+    assert(c.top == 0);
+    free(c.stack);
+    return NULL;
+}
+
+// 栈顶的v->array_size个元素全为数字时，以double数组存入v并出栈
+static int lept_pack_numbers(lept_content* c, lept_value* v) {
+    size_t i, size = v->array_size;
+    const lept_value* e = (const lept_value*)(c->stack + c->top) - size;
+    for (i = 0; i < size; i++)
+        if (e[i].type != LEPT_NUMBER)
+            return 0;
+    v->numbers = (double*)malloc(size * sizeof(double));
+    for (i = 0; i < size; i++)
+        v->numbers[i] = e[i].n;
+    lept_content_pop(c, size * sizeof(lept_value));
+    v->packed = 1;
+    return 1;
+}
+
+static void lept_array_unpack(lept_value* v) {
+    size_t i;
+    lept_value* array = (lept_value*)malloc(v->array_size * sizeof(lept_value));
+    for (i = 0; i < v->array_size; i++) {
+        array[i].n = v->numbers[i];
+        array[i].type = LEPT_NUMBER;
+    }
+    free(v->numbers);
+    v->array = array;
+    v->packed = 0;
+}
+
+static void lept_array_pack(lept_value* v) {
+    size_t i;
+    double* numbers = (double*)malloc(v->array_size * sizeof(double));
+    for (i = 0; i < v->array_size; i++) {
+        assert(v->array[i].type == LEPT_NUMBER);
+        numbers[i] = v->array[i].n;
+    }
+    free(v->array);
+    v->numbers = numbers;
+    v->packed = 1;
+}
+
+static const lept_value* lept_array_at(const lept_value* v, size_t index, lept_value* temp) {
+    if (!v->packed)
+        return &v->array[index];
+    temp->n = v->numbers[index];
+    temp->type = LEPT_NUMBER;
+    return temp;
+}
+
+static int lept_array_number_at(const lept_value* v, size_t index, double* d) {
+    if (v->packed) {
+        *d = v->numbers[index];
+        return 1;
+    }
+    if (v->array[index].type != LEPT_NUMBER)
+        return 0;
+    *d = v->array[index].n;
+    return 1;
+}
+
+static int lept_parse_object(lept_content* c, lept_value* v) {
+    size_t size = 0, i, key_len;
+    int ret;
+    lept_member m;
+    lept_member* release;
+    EXPECT(c, '{');
+    c->json++;
+    lept_parse_whitespace(c);
+    if (*c->json == '}') {
+        c->json++;
+        v->object_size = 0;
+        v->object = NULL;
+        v->type = LEPT_OBJECT;
+        return LEPT_PARSE_OK;
+    }
+    while (1) {
+        // 初始化lept_member
+        m.key = NULL;
+        m.key_len = 0;
+        lept_init(&m.v);
+        char* tmp;
+        if (*c->json != '\"') {
+            ret = LEPT_PARSE_MISS_KEY;
+            break;
+        }
+        if ((ret = lept_parse_string_raw(c, &tmp, &key_len)) != LEPT_PARSE_OK)
+            break;
+        m.key_len = key_len;
+        // 键解析成功， 给m的键分配内存
+        m.key = (char*)malloc(m.key_len + 1);
+        memcpy(m.key, tmp, m.key_len);
+        m.key[m.key_len] = '\0';
+        lept_parse_whitespace(c);
+        if (*c->json == ':') {
+            c->json++;
+            lept_parse_whitespace(c);
+        }
+        else {
+            ret = LEPT_PARSE_MISS_COLON;
+            free(m.key);
+            break;
+        }
+        if ((ret = lept_parse_value(c, &m.v)) != LEPT_PARSE_OK) {
+            free(m.key);
+            break;
+        }
+        // 值解析成功
+        memcpy(lept_content_push(c, sizeof(lept_member)), &m, sizeof(lept_member));
+        size++;
+        if (size > LEPT_SIZE_MAX) {
+            ret = LEPT_PARSE_TOO_LONG;
+            break;
+        }
+        lept_parse_whitespace(c);
+        // 下一个键值对
+        if (*c->json == ',') {
+            c->json++;
+            lept_parse_whitespace(c);
+        }
+        else if (*c->json == '}') {
+            c->json++;
+            v->object_size = size;
+            size *= sizeof(lept_member);
+            memcpy(v->object = (lept_member*)malloc(size), lept_content_pop(c, size), size);
+            v->type = LEPT_OBJECT;
+            return LEPT_PARSE_OK;
+        }
+        else {
+            ret = LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+            break;
+        }
+    }
+    // 解析失败，释放之前的内存
+    for (i = 0; i < size; i++) {
+        release = (lept_member*)lept_content_pop(c, sizeof(lept_member));
+        free(release->key);
+    }
+    return ret;
+}
+
+static uint64_t lept_hash_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// 按小端读取8字节，保证不同平台上哈希值一致
+static uint64_t lept_load64(const unsigned char* p) {
+    return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24 |
+        (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 | (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+static uint64_t lept_hash_bytes(const void* data, size_t len, uint64_t seed) {
+    const unsigned char* p = (const unsigned char*)data;
+    uint64_t h = seed ^ (len * LEPT_HASH_PRIME);
+    uint64_t tail = 0;
+    size_t i;
+    // 每次处理8字节
+    for (; len >= 8; p += 8, len -= 8)
+        h = (h ^ lept_hash_mix(lept_load64(p))) * LEPT_HASH_PRIME;
+    for (i = 0; i < len; i++)
+        tail |= (uint64_t)p[i] << (i * 8);
+    h ^= lept_hash_mix(tail);
+    return lept_hash_mix(h);
+}
+
+static uint64_t lept_hash_number(double d) {
+    uint64_t bits;
+    // -0.0 == 0.0，两者哈希也必须相同
+    if (d == 0.0)
+        d = 0.0;
+    memcpy(&bits, &d, sizeof(bits));
+    return lept_hash_mix(bits ^ LEPT_HASH_SEED(LEPT_NUMBER));
+}
+
+static size_t lept_object_index(const lept_value* v, lept_content* scratch, size_t* mask, size_t* distinct) {
+    size_t cap = 1, i, j, offset = scratch->top;
+    size_t* slots; // 存放成员下标+1，0表示空位
+    *distinct = 0;
+    *mask = 0;
+    // 成员较少时不建索引，直接线性查找
+    if (v->object_size <= LEPT_EQUAL_LINEAR_MAX) {
+        for (i = 0; i < v->object_size; i++)
+            *distinct += lept_object_first(v, NULL, 0, v->object[i].key, v->object[i].key_len) == &v->object[i];
+        return offset;
+    }
+    // 容量取不小于2n的2的幂，保证线性探测较短
+    while (cap < v->object_size * 2)
+        cap <<= 1;
+    *mask = cap - 1;
+    slots = (size_t*)lept_content_push(scratch, cap * sizeof(size_t));
+    memset(slots, 0, cap * sizeof(size_t));
+    for (i = 0; i < v->object_size; i++) {
+        const lept_member* m = &v->object[i];
+        j = lept_hash_bytes(m->key, m->key_len, 0) & *mask;
+        while (slots[j] != 0) {
+            const lept_member* o = &v->object[slots[j] - 1];
+            if (o->key_len == m->key_len && memcmp(o->key, m->key, m->key_len) == 0)
+                break;
+            j = (j + 1) & *mask;
+        }
+        // 重复的键只保留第一次出现
+        if (slots[j] == 0) {
+            slots[j] = i + 1;
+            (*distinct)++;
+        }
+    }
+    return offset;
+}
+
+static void lept_object_index_free(lept_content* scratch, size_t mask) {
+    if (mask != 0)
+        lept_content_pop(scratch, (mask + 1) * sizeof(size_t));
+}
+
+static const lept_member* lept_object_first(const lept_value* v, const size_t* slots, size_t mask, const char* key, size_t klen) {
+    size_t j;
+    if (slots == NULL) {
+        for (j = 0; j < v->object_size; j++)
+            if (v->object[j].key_len == klen && memcmp(v->object[j].key, key, klen) == 0)
+                return &v->object[j];
+        return NULL;
+    }
+    for (j = lept_hash_bytes(key, klen, 0) & mask; slots[j] != 0; j = (j + 1) & mask) {
+        const lept_member* o = &v->object[slots[j] - 1];
+        if (o->key_len == klen && memcmp(o->key, key, klen) == 0)
+            return o;
+    }
+    return NULL;
+}
+
+static int lept_is_equal_object(const lept_value* lhs, const lept_value* rhs, lept_content* scratch) {
+    size_t i, lmask, rmask, ldistinct, rdistinct;
+    size_t lslots = lept_object_index(lhs, scratch, &lmask, &ldistinct);
+    size_t rslots = lept_object_index(rhs, scratch, &rmask, &rdistinct);
+    // 不同的键一样多，且lhs的每个键都在rhs中，两边的键集合就相同
+    int ret = ldistinct == rdistinct;
+    for (i = 0; i < lhs->object_size && ret; i++) {
+        const lept_member* m = &lhs->object[i];
+        const lept_member* found;
+        if (lept_object_first(lhs, LEPT_SCRATCH_SLOTS(scratch, lslots, lmask), lmask, m->key, m->key_len) != m)
+            continue;
+        found = lept_object_first(rhs, LEPT_SCRATCH_SLOTS(scratch, rslots, rmask), rmask, m->key, m->key_len);
+        ret = found != NULL && lept_is_equal_value(&m->v, &found->v, scratch);
+    }
+    // 后建的索引在栈顶，先出栈
+    lept_object_index_free(scratch, rmask);
+    lept_object_index_free(scratch, lmask);
+    return ret;
+}
+
+static size_t lept_value_memory(const lept_value* v) {
+    size_t i, size = 0;
+    switch (v->type) {
+        case LEPT_STRING:
+            return v->len + 1;
+        case LEPT_ARRAY:
+            if (v->packed)
+                return v->array_size * sizeof(double);
+            size = v->array_size * sizeof(lept_value);
+            for (i = 0; i < v->array_size; i++)
+                size += lept_value_memory(&v->array[i]);
+            return size;
+        case LEPT_OBJECT:
+            size = v->object_size * sizeof(lept_member);
+            for (i = 0; i < v->object_size; i++)
+                size += v->object[i].key_len + 1 + lept_value_memory(&v->object[i].v);
+            return size;
+        default:
+            return 0;
+    }
+}
+
+// 以下函数调用时必须持有cache->lock
+static lept_cache_entry* lept_cache_lookup(lept_cache* cache, const char* json, size_t len, uint64_t h) {
+    lept_cache_entry* e = cache->buckets[h & cache->bucket_mask];
+    for (; e != NULL; e = e->chain)
+        if (e->hash == h && e->len == len && memcmp(e->json, json, len) == 0)
+            return e;
+    return NULL;
+}
+
+// 将条目移到LRU链表头部
+static void lept_cache_touch(lept_cache* cache, lept_cache_entry* e) {
+    if (cache->head == e)
+        return;
+    e->prev->next = e->next;
+    if (e->next != NULL)
+        e->next->prev = e->prev;
+    else
+        cache->tail = e->prev;
+    e->prev = NULL;
+    e->next = cache->head;
+    cache->head->prev = e;
+    cache->head = e;
+}
+
+// 从哈希桶和LRU链表中移除条目，不改变引用计数
+static void lept_cache_unlink(lept_cache* cache, lept_cache_entry* e) {
+    lept_cache_entry** pp = &cache->buckets[e->hash & cache->bucket_mask];
+    while (*pp != e)
+        pp = &(*pp)->chain;
+    *pp = e->chain;
+    if (e->prev != NULL)
+        e->prev->next = e->next;
+    else
+        cache->head = e->next;
+    if (e->next != NULL)
+        e->next->prev = e->prev;
+    else
+        cache->tail = e->prev;
+    cache->stats.entries--;
+    cache->stats.memory -= e->memory;
+}
+
+static void lept_validate_whitespace(lept_validator* c) {
+    const char* p = c->json;
+    while (p < c->end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+        p++;
+    c->json = p;
+}
+
+static int lept_validate_value(lept_validator* c) {
+    switch (LEPT_PEEK(c)) {
+        case 'n': return lept_validate_literal(c, "null");
+        case 't': return lept_validate_literal(c, "true");
+        case 'f': return lept_validate_literal(c, "false");
+        case '\"': return lept_validate_string(c);
+        case '[': return lept_validate_array(c);
+        case '{': return lept_validate_object(c);
+        case '\0': return LEPT_PARSE_EXPECT_VALUE;
+        default: return lept_validate_number(c);
+    }
+}
+
+static int lept_validate_literal(lept_validator* c, const char* literal) {
+    size_t index = 1;
+    while (literal[index] != '\0') {
+        if (c->json + index >= c->end || c->json[index] != literal[index])
+            return LEPT_PARSE_INVALID_VALUE;
+        index++;
+    }
+    c->json += index;
+    return LEPT_PARSE_OK;
+}
+
+#define VALIDATE_PEEK(p) ((p) < c->end ? *(p) : '\0')
+
+static int lept_validate_number(lept_validator* c) {
+    const char* p = c->json;
+    if (VALIDATE_PEEK(p) == '-')
+        p++;
+    if (VALIDATE_PEEK(p) == '0') p++;
+    else {
+        if (!ISDIGIT0TO9(VALIDATE_PEEK(p))) return LEPT_PARSE_INVALID_VALUE;
+        for (p++; ISDIGIT(VALIDATE_PEEK(p)); p++);
+    }
+    if (VALIDATE_PEEK(p) == '.') {
+        p++;
+        if (!ISDIGIT(VALIDATE_PEEK(p))) return LEPT_PARSE_INVALID_VALUE;
+        for (p++; ISDIGIT(VALIDATE_PEEK(p)); p++);
+    }
+    if (VALIDATE_PEEK(p) == 'e' || VALIDATE_PEEK(p) == 'E') {
+        p++;
+        if (VALIDATE_PEEK(p) == '-' || VALIDATE_PEEK(p) == '+') p++;
+        if (!ISDIGIT(VALIDATE_PEEK(p))) return LEPT_PARSE_INVALID_VALUE;
+        for (p++; ISDIGIT(VALIDATE_PEEK(p)); p++);
+    }
+    if (lept_number_too_big(c->json, p))
+        return LEPT_PARSE_NUMBER_TOO_BIG;
+    c->json = p;
+    return LEPT_PARSE_OK;
+}
+
+static int lept_validate_hex4(lept_validator* c, unsigned* u) {
+    int i;
+    *u = 0;
+    for (i = 0; i < 4; i++) {
+        char ch = LEPT_PEEK(c);
+        *u <<= 4;
+        if (ch >= '0' && ch <= '9') *u |= ch - '0';
+        else if (ch >= 'A' && ch <= 'F') *u |= ch - 'A' + 10;
+        else if (ch >= 'a' && ch <= 'f') *u |= ch - 'a' + 10;
+        else return 0;
+        c->json++;
+    }
+    return 1;
+}
+
+// 与lept_parse_string_raw相同的检查，但不保存解码后的字符
+static int lept_validate_string(lept_validator* c) {
+    unsigned u, u2;
+    c->json++;
+    while (1) {
+        char ch;
+        c->json += lept_scan_string_plain_n(c->json, (size_t)(c->end - c->json));
+        ch = LEPT_PEEK(c);
+        switch (ch) {
+            case '\"':
+                c->json++;
+                return LEPT_PARSE_OK;
+            case '\0':
+                return LEPT_PARSE_MISS_QUOTATION_MARK;
+            case '\\':
+                c->json++;
+                switch (LEPT_PEEK(c)) {
+                    case '\"': case '\\': case '/':
+                    case 'b': case 'f': case 'n': case 'r': case 't':
+                        c->json++;
+                        break;
+                    case 'u':
+                        c->json++;
+                        if (!lept_validate_hex4(c, &u))
+                            return LEPT_PARSE_INVALID_UNICODE_HEX;
+                        if (u >= 0xD800 && u <= 0xD8FF) {
+                            if (LEPT_PEEK(c) != '\\')
+                                return LEPT_PARSE_INVALID_UNICODE_SURROGATE;
+                            c->json++;
+                            if (LEPT_PEEK(c) != 'u')
+                                return LEPT_PARSE_INVALID_UNICODE_SURROGATE;
+                            c->json++;
+                            if (!lept_validate_hex4(c, &u2))
+                                return LEPT_PARSE_INVALID_UNICODE_HEX;
+                            if (u2 < 0xDC00 || u2 > 0xDFFF)
+                                return LEPT_PARSE_INVALID_UNICODE_SURROGATE;
+                        }
+                        break;
+                    default:
+                        return LEPT_PARSE_INVALID_STRING_ESCAPE;
+                }
+                break;
+            default:
+                if ((unsigned char)ch < 0x20)
+                    return LEPT_PARSE_INVALID_STRING_CHAR;
+                c->json++;
+        }
+    }
+}
+
+static int lept_validate_array(lept_validator* c) {
+    int ret;
+    c->json++;
+    lept_validate_whitespace(c);
+    if (LEPT_PEEK(c) == ']') {
+        c->json++;
+        return LEPT_PARSE_OK;
+    }
+    while (1) {
+        if ((ret = lept_validate_value(c)) != LEPT_PARSE_OK)
+            return ret;
+        lept_validate_whitespace(c);
+        if (LEPT_PEEK(c) == ',') {
+            c->json++;
+            lept_validate_whitespace(c);
+        }
+        else if (LEPT_PEEK(c) == ']') {
+            c->json++;
+            return LEPT_PARSE_OK;
+        }
+        else
+            return LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+    }
+}
+
+static int lept_validate_object(lept_validator* c) {
+    int ret;
+    c->json++;
+    lept_validate_whitespace(c);
+    if (LEPT_PEEK(c) == '}') {
+        c->json++;
+        return LEPT_PARSE_OK;
+    }
+    while (1) {
+        if (LEPT_PEEK(c) != '\"')
+            return LEPT_PARSE_MISS_KEY;
+        if ((ret = lept_validate_string(c)) != LEPT_PARSE_OK)
+            return ret;
+        lept_validate_whitespace(c);
+        if (LEPT_PEEK(c) != ':')
+            return LEPT_PARSE_MISS_COLON;
+        c->json++;
+        lept_validate_whitespace(c);
+        if ((ret = lept_validate_value(c)) != LEPT_PARSE_OK)
+            return ret;
+        lept_validate_whitespace(c);
+        if (LEPT_PEEK(c) == ',') {
+            c->json++;
+            lept_validate_whitespace(c);
+        }
+        else if (LEPT_PEEK(c) == '}') {
+            c->json++;
+            return LEPT_PARSE_OK;
+        }
+        else
+            return LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+    }
+}
+
+// 长度较短的数字复制到栈上交给strtod
+// 更长的数字只保留前LEPT_NUMBER_DIGITS位有效数字，并把小数点位置折算进指数
+#define LEPT_NUMBER_DIGITS 40
+
+static int lept_number_too_big(const char* start, const char* end) {
+    char buf[64], digits[LEPT_NUMBER_DIGITS];
+    size_t n = (size_t)(end - start), ndigits = 0;
+    const char* p = start;
+    long exp10 = 0, e = 0;
+    int neg = 0, eneg = 0;
+    double d;
+    if (n < sizeof(buf)) {
+        memcpy(buf, start, n);
+        buf[n] = '\0';
+        errno = 0;
+        d = strtod(buf, NULL);
+        return errno == ERANGE && (d == HUGE_VAL || d == -HUGE_VAL);
+    }
+    if (*p == '-') {
+        neg = 1;
+        p++;
+    }
+    // 数值为0.d1d2d3... * 10^exp10
+    for (; p < end && ISDIGIT(*p); p++) {
+        if (ndigits == 0 && *p == '0')
+            continue;
+        if (ndigits < LEPT_NUMBER_DIGITS)
+            digits[ndigits++] = *p;
+        exp10++;
+    }
+    if (p < end && *p == '.')
+        for (p++; p < end && ISDIGIT(*p); p++) {
+            if (ndigits == 0 && *p == '0') {
+                exp10--;
+                continue;
+            }
+            if (ndigits < LEPT_NUMBER_DIGITS)
+                digits[ndigits++] = *p;
+        }
+    if (ndigits == 0)
+        return 0;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if (*p == '-' || *p == '+')
+            eneg = *p++ == '-';
+        // 指数过大时截断，结果已经可以确定
+        for (; p < end && ISDIGIT(*p); p++)
+            if (e < 100000)
+                e = e * 10 + (*p - '0');
+    }
+    exp10 += eneg ? -e : e;
+    if (exp10 > 400)
+        return 1;
+    if (exp10 < -400)
+        return 0;
+    sprintf(buf, "%s0.%.*se%ld", neg ? "-" : "", (int)ndigits, digits, exp10);
+    errno = 0;
+    d = strtod(buf, NULL);
+    return errno == ERANGE && (d == HUGE_VAL || d == -HUGE_VAL);
+}
+
+static void lept_set_container(lept_value* v, lept_type type) {
+    assert(type == LEPT_ARRAY || type == LEPT_OBJECT);
+    lept_free(v);
+    v->array = NULL;
+    v->array_size = 0;
+    v->type = type;
+    v->packed = 0;
+}
+
+static lept_value* lept_object_append(lept_value* v, const char* key, size_t klen) {
+    lept_member* m;
+    assert(v->type == LEPT_OBJECT && v->object_size < LEPT_SIZE_MAX);
+    v->object = (lept_member*)realloc(v->object, (v->object_size + 1) * sizeof(lept_member));
+    m = &v->object[v->object_size++];
+    m->key = (char*)malloc(klen + 1);
+    memcpy(m->key, key, klen);
+    m->key[klen] = '\0';
+    m->key_len = klen;
+    lept_init(&m->v);
+    return &m->v;
+}
+
+static void lept_object_remove(lept_value* v, size_t index) {
+    assert(v->type == LEPT_OBJECT && index < v->object_size);
+    free(v->object[index].key);
+    lept_free(&v->object[index].v);
+    memmove(&v->object[index], &v->object[index + 1], (v->object_size - index - 1) * sizeof(lept_member));
+    v->object_size--;
+}
+
+static lept_value* lept_array_insert(lept_value* v, size_t index) {
+    assert(v->type == LEPT_ARRAY && index <= v->array_size && v->array_size < LEPT_SIZE_MAX);
+    if (v->packed)
+        lept_array_unpack(v);
+    v->array = (lept_value*)realloc(v->array, (v->array_size + 1) * sizeof(lept_value));
+    memmove(&v->array[index + 1], &v->array[index], (v->array_size - index) * sizeof(lept_value));
+    v->array_size++;
+    lept_init(&v->array[index]);
+    return &v->array[index];
+}
+
+static void lept_array_erase(lept_value* v, size_t index) {
+    assert(v->type == LEPT_ARRAY && index < v->array_size);
+    if (v->packed)
+        lept_array_unpack(v);
+    lept_free(&v->array[index]);
+    memmove(&v->array[index], &v->array[index + 1], (v->array_size - index - 1) * sizeof(lept_value));
+    v->array_size--;
+}
+
+static int lept_token_equal(const char* t, size_t tlen, const char* key, size_t klen) {
+    size_t i, j;
+    for (i = 0, j = 0; i < tlen && j < klen; i++, j++) {
+        char ch = t[i];
+        if (ch == '~') {
+            // ~后面只能是0或1，否则不与任何键相同
+            if (i + 1 == tlen || (t[i + 1] != '0' && t[i + 1] != '1'))
+                return 0;
+            ch = t[++i] == '0' ? '~' : '/';
+        }
+        if (ch != key[j])
+            return 0;
+    }
+    return i == tlen && j == klen;
+}
+
+static size_t lept_token_unescape(const char* t, size_t tlen, char* out) {
+    size_t i, n = 0;
+    for (i = 0; i < tlen; i++) {
+        if (t[i] == '~') {
+            assert(i + 1 < tlen && (t[i + 1] == '0' || t[i + 1] == '1'));
+            out[n++] = t[++i] == '0' ? '~' : '/';
+        }
+        else
+            out[n++] = t[i];
+    }
+    return n;
+}
+
+static int lept_pointer_valid(const char* ptr, size_t len) {
+    size_t i;
+    if (len > 0 && *ptr != '/')
+        return 0;
+    for (i = 0; i < len; i++)
+        if (ptr[i] == '~' && (++i == len || (ptr[i] != '0' && ptr[i] != '1')))
+            return 0;
+    return 1;
+}
+
+static int lept_token_index(const char* t, size_t tlen, size_t* index) {
+    size_t i;
+    // 不允许前导0
+    if (tlen == 0 || (tlen > 1 && t[0] == '0'))
+        return 0;
+    *index = 0;
+    for (i = 0; i < tlen; i++) {
+        if (!ISDIGIT(t[i]) || *index > (SIZE_MAX - 9) / 10)
+            return 0;
+        *index = *index * 10 + (size_t)(t[i] - '0');
+    }
+    return 1;
+}
+
+static lept_value* lept_pointer_child(lept_value* v, const char* t, size_t tlen) {
+    size_t i;
+    if (v->type == LEPT_OBJECT) {
+        for (i = 0; i < v->object_size; i++)
+            if (lept_token_equal(t, tlen, v->object[i].key, v->object[i].key_len))
+                return &v->object[i].v;
+        return NULL;
+    }
+    if (v->type == LEPT_ARRAY && lept_token_index(t, tlen, &i) && i < v->array_size) {
+        assert(!v->packed);
+        return &v->array[i];
+    }
+    return NULL;
+}
+
+static lept_value* lept_pointer_resolve(lept_value* root, const char* ptr, size_t len, lept_content* log) {
+    const char* start = ptr;
+    const char* end = ptr + len;
+    const char* q;
+    // 空路径表示整个文档，否则必须以'/'开头
+    if (len > 0 && *ptr != '/')
+        return NULL;
+    while (root != NULL && ptr < end) {
+        // 补丁可能修改数组中的元素，先展开
+        if (root->type == LEPT_ARRAY)
+            lept_patch_unpack(root, start, (size_t)(ptr - start), log);
+        for (q = ++ptr; q < end && *q != '/'; q++);
+        root = lept_pointer_child(root, ptr, (size_t)(q - ptr));
+        ptr = q;
+    }
+    return root;
+}
+
+static lept_patch_undo* lept_patch_log(lept_content* log, lept_undo_type type, const char* path, size_t len, size_t index) {
+    lept_patch_undo* u = (lept_patch_undo*)lept_content_push(log, sizeof(lept_patch_undo));
+    u->path = path;
+    u->len = len;
+    u->index = index;
+    u->type = type;
+    u->moved = 0;
+    u->key = NULL;
+    u->key_len = 0;
+    lept_init(&u->old);
+    return u;
+}
+
+static void lept_patch_unpack(lept_value* v, const char* path, size_t len, lept_content* log) {
+    if (!v->packed)
+        return;
+    assert(log != NULL);
+    lept_patch_log(log, LEPT_UNDO_UNPACK, path, len, 0);
+    lept_array_unpack(v);
+}
+
+static void lept_patch_rollback(lept_value* root, lept_content* log) {
+    lept_value carry; // 上一步撤销时被替换出来的值，move的第一步从这里取回
+    lept_value* v;
+    lept_patch_undo* u;
+    lept_init(&carry);
+    while (log->top > 0) {
+        u = (lept_patch_undo*)lept_content_pop(log, sizeof(lept_patch_undo));
+        v = lept_pointer_resolve(root, u->path, u->len, NULL);
+        assert(v != NULL);
+        switch (u->type) {
+            case LEPT_UNDO_SET:
+                lept_swap(v, u->moved ? &carry : &u->old);
+                if (!u->moved)
+                    lept_move(&carry, &u->old);
+                break;
+            case LEPT_UNDO_INSERTED:
+                if (v->type == LEPT_OBJECT) {
+                    lept_move(&carry, &v->object[u->index].v);
+                    lept_object_remove(v, u->index);
+                }
+                else {
+                    lept_move(&carry, &v->array[u->index]);
+                    lept_array_erase(v, u->index);
+                }
+                break;
+            case LEPT_UNDO_REMOVED:
+                if (v->type == LEPT_OBJECT) {
+                    lept_member* m;
+                    lept_object_append(v, "", 0);
+                    m = &v->object[v->object_size - 1];
+                    free(m->key);
+                    memmove(&v->object[u->index + 1], &v->object[u->index], (v->object_size - u->index - 1) * sizeof(lept_member));
+                    m = &v->object[u->index];
+                    m->key = u->key;
+                    m->key_len = u->key_len;
+                    u->key = NULL;
+                    lept_init(&m->v);
+                    lept_move(&m->v, u->moved ? &carry : &u->old);
+                }
+                else
+                    lept_move(lept_array_insert(v, u->index), u->moved ? &carry : &u->old);
+                break;
+            default:
+                lept_array_pack(v);
+                break;
+        }
+        free(u->key);
+        lept_free(&u->old);
+    }
+    lept_free(&carry);
+}
+
+// 将路径分为父节点和最后一个片段
+#define LEPT_POINTER_SPLIT(path, len, last) \
+    do { \
+        for (last = (path) + (len); last > (path) && last[-1] != '/'; last--); \
+    } while (0)
+
+static int lept_patch_add(lept_value* root, const char* path, size_t len, lept_value* value, lept_content* log) {
+    const char* last;
+    lept_value* parent;
+    size_t tlen, plen, index;
+    if (len == 0) {
+        lept_move(&lept_patch_log(log, LEPT_UNDO_SET, path, 0, 0)->old, root);
+        lept_move(root, value);
+        return LEPT_PATCH_OK;
+    }
+    LEPT_POINTER_SPLIT(path, len, last);
+    if (last == path)
+        return LEPT_PATCH_INVALID;
+    plen = (size_t)(last - path - 1);
+    if ((parent = lept_pointer_resolve(root, path, plen, log)) == NULL)
+        return LEPT_PATCH_PATH_NOT_FOUND;
+    tlen = (size_t)(path + len - last);
+    if (parent->type == LEPT_OBJECT) {
+        lept_value* slot = lept_pointer_child(parent, last, tlen);
+        if (slot == NULL) {
+            char* key = (char*)malloc(tlen + 1);
+            slot = lept_object_append(parent, key, lept_token_unescape(last, tlen, key));
+            free(key);
+            lept_patch_log(log, LEPT_UNDO_INSERTED, path, plen, parent->object_size - 1);
+        }
+        else
+            lept_move(&lept_patch_log(log, LEPT_UNDO_SET, path, len, 0)->old, slot);
+        lept_move(slot, value);
+        return LEPT_PATCH_OK;
+    }
+    if (parent->type == LEPT_ARRAY) {
+        if (tlen == 1 && *last == '-')
+            index = parent->array_size;
+        else if (!lept_token_index(last, tlen, &index) || index > parent->array_size)
+            return LEPT_PATCH_PATH_NOT_FOUND;
+        lept_patch_unpack(parent, path, plen, log);
+        lept_move(lept_array_insert(parent, index), value);
+        lept_patch_log(log, LEPT_UNDO_INSERTED, path, plen, index);
+        return LEPT_PATCH_OK;
+    }
+    return LEPT_PATCH_PATH_NOT_FOUND;
+}
+
+// 移除路径上的值，removed不为NULL时把值移出到removed中
+static int lept_patch_remove(lept_value* root, const char* path, size_t len, lept_value* removed, lept_content* log) {
+    const char* last;
+    lept_value* parent;
+    lept_patch_undo* u;
+    size_t tlen, plen, i;
+    if (len == 0) {
+        u = lept_patch_log(log, LEPT_UNDO_SET, path, 0, 0);
+        u->moved = removed != NULL;
+        lept_move(removed != NULL ? removed : &u->old, root);
+        return LEPT_PATCH_OK;
+    }
+    LEPT_POINTER_SPLIT(path, len, last);
+    if (last == path)
+        return LEPT_PATCH_INVALID;
+    plen = (size_t)(last - path - 1);
+    if ((parent = lept_pointer_resolve(root, path, plen, log)) == NULL)
+        return LEPT_PATCH_PATH_NOT_FOUND;
+    tlen = (size_t)(path + len - last);
+    if (parent->type == LEPT_OBJECT) {
+        for (i = 0; i < parent->object_size; i++)
+            if (lept_token_equal(last, tlen, parent->object[i].key, parent->object[i].key_len)) {
+                // 键交给撤销记录，回滚时原样放回
+                u = lept_patch_log(log, LEPT_UNDO_REMOVED, path, plen, i);
+                u->moved = removed != NULL;
+                u->key = parent->object[i].key;
+                u->key_len = parent->object[i].key_len;
+                parent->object[i].key = NULL;
+                lept_move(removed != NULL ? removed : &u->old, &parent->object[i].v);
+                lept_object_remove(parent, i);
+                return LEPT_PATCH_OK;
+            }
+        return LEPT_PATCH_PATH_NOT_FOUND;
+    }
+    if (parent->type == LEPT_ARRAY && lept_token_index(last, tlen, &i) && i < parent->array_size) {
+        lept_patch_unpack(parent, path, plen, log);
+        u = lept_patch_log(log, LEPT_UNDO_REMOVED, path, plen, i);
+        u->moved = removed != NULL;
+        lept_move(removed != NULL ? removed : &u->old, &parent->array[i]);
+        lept_array_erase(parent, i);
+        return LEPT_PATCH_OK;
+    }
+    return LEPT_PATCH_PATH_NOT_FOUND;
+}
+
+static int lept_patch_op(lept_value* root, lept_value* op, lept_content* log) {
+    lept_value* name;
+    lept_value* path;
+    lept_value* from = NULL;
+    lept_value* value = NULL;
+    lept_value* target;
+    lept_value temp;
+    const char* s;
+    size_t mark;
+    int ret;
+    if (op->type != LEPT_OBJECT ||
+        (name = lept_find_object_value(op, "op", 2)) == NULL || name->type != LEPT_STRING ||
+        (path = lept_find_object_value(op, "path", 4)) == NULL || path->type != LEPT_STRING)
+        return LEPT_PATCH_INVALID;
+    s = name->s;
+    if (strcmp(s, "add") == 0 || strcmp(s, "replace") == 0 || strcmp(s, "test") == 0) {
+        if ((value = lept_find_object_value(op, "value", 5)) == NULL)
+            return LEPT_PATCH_INVALID;
+    }
+    else if (strcmp(s, "move") == 0 || strcmp(s, "copy") == 0) {
+        if ((from = lept_find_object_value(op, "from", 4)) == NULL || from->type != LEPT_STRING)
+            return LEPT_PATCH_INVALID;
+    }
+    else if (strcmp(s, "remove") != 0)
+        return LEPT_PATCH_INVALID;
+    if (!lept_pointer_valid(path->s, path->len) || (from != NULL && !lept_pointer_valid(from->s, from->len)))
+        return LEPT_PATCH_INVALID;
+
+    switch (s[0]) {
+        case 'a':
+            return lept_patch_add(root, path->s, path->len, value, log);
+        case 'r':
+            if (s[2] == 'm')
+                return lept_patch_remove(root, path->s, path->len, NULL, log);
+            // replace只修改已有的位置
+            if ((target = lept_pointer_resolve(root, path->s, path->len, log)) == NULL)
+                return LEPT_PATCH_PATH_NOT_FOUND;
+            lept_move(&lept_patch_log(log, LEPT_UNDO_SET, path->s, path->len, 0)->old, target);
+            lept_move(target, value);
+            return LEPT_PATCH_OK;
+        case 't':
+            if ((target = lept_pointer_resolve(root, path->s, path->len, log)) == NULL)
+                return LEPT_PATCH_PATH_NOT_FOUND;
+            return lept_is_equal(target, value) ? LEPT_PATCH_OK : LEPT_PATCH_TEST_FAILED;
+        case 'c':
+            if ((target = lept_pointer_resolve(root, from->s, from->len, log)) == NULL)
+                return LEPT_PATCH_PATH_NOT_FOUND;
+            lept_init(&temp);
+            lept_copy(&temp, target);
+            break;
+        default: /* move */
+            // 不能移动到自己的子节点中
+            if (path->len > from->len && memcmp(path->s, from->s, from->len) == 0 && path->s[from->len] == '/')
+                return LEPT_PATCH_INVALID;
+            lept_init(&temp);
+            if ((ret = lept_patch_remove(root, from->s, from->len, &temp, log)) != LEPT_PATCH_OK)
+                return ret;
+            mark = log->top - sizeof(lept_patch_undo);
+            if ((ret = lept_patch_add(root, path->s, path->len, &temp, log)) != LEPT_PATCH_OK) {
+                // 值还没放到新位置，交给移除的记录，回滚时直接放回
+                lept_patch_undo* u = (lept_patch_undo*)(log->stack + mark);
+                lept_move(&u->old, &temp);
+                u->moved = 0;
+            }
+            return ret;
+    }
+    ret = lept_patch_add(root, path->s, path->len, &temp, log);
+    lept_free(&temp);
+    return ret;
+}
+
+static void lept_diff_value(lept_content* path, lept_content* scratch, const lept_value* from, const lept_value* to, lept_value* patch) {
+    size_t i, top = path->top, common, head = 0, tail = 0, fend, tend;
+    size_t fslots, tslots, fmask, tmask, fdistinct, tdistinct;
+    char buf[32];
+    lept_value a, b;
+    // 不预先比较整棵子树，相同的部分递归下去不会生成操作
+    if (from->type == LEPT_OBJECT && to->type == LEPT_OBJECT) {
+        // 每对对象只建一次索引，重复的键只比较第一次出现
+        fslots = lept_object_index(from, scratch, &fmask, &fdistinct);
+        tslots = lept_object_index(to, scratch, &tmask, &tdistinct);
+        for (i = 0; i < from->object_size; i++) {
+            const lept_member* m = &from->object[i];
+            const lept_member* other;
+            if (lept_object_first(from, LEPT_SCRATCH_SLOTS(scratch, fslots, fmask), fmask, m->key, m->key_len) != m)
+                continue;
+            other = lept_object_first(to, LEPT_SCRATCH_SLOTS(scratch, tslots, tmask), tmask, m->key, m->key_len);
+            lept_diff_push_token(path, m->key, m->key_len);
+            if (other == NULL)
+                lept_diff_op(patch, "remove", path, NULL);
+            else
+                lept_diff_value(path, scratch, &m->v, &other->v, patch);
+            path->top = top;
+        }
+        for (i = 0; i < to->object_size; i++) {
+            const lept_member* m = &to->object[i];
+            if (lept_object_first(to, LEPT_SCRATCH_SLOTS(scratch, tslots, tmask), tmask, m->key, m->key_len) != m ||
+                lept_object_first(from, LEPT_SCRATCH_SLOTS(scratch, fslots, fmask), fmask, m->key, m->key_len) != NULL)
+                continue;
+            lept_diff_push_token(path, m->key, m->key_len);
+            lept_diff_op(patch, "add", path, &m->v);
+            path->top = top;
+        }
+        lept_object_index_free(scratch, tmask);
+        lept_object_index_free(scratch, fmask);
+        return;
+    }
+    if (from->type == LEPT_ARRAY && to->type == LEPT_ARRAY) {
+        common = from->array_size < to->array_size ? from->array_size : to->array_size;
+        // 长度不同时去掉相同的前缀和后缀，两端的插入或删除只生成一个操作
+        // 长度相同时按下标配对的结果一样，省去逐个比较
+        if (from->array_size != to->array_size) {
+            for (; head < common; head++)
+                if (!lept_is_equal_value(lept_array_at(from, head, &a), lept_array_at(to, head, &b), scratch))
+                    break;
+            for (; tail < common - head; tail++)
+                if (!lept_is_equal_value(lept_array_at(from, from->array_size - tail - 1, &a),
+                                         lept_array_at(to, to->array_size - tail - 1, &b), scratch))
+                    break;
+        }
+        fend = from->array_size - tail;
+        tend = to->array_size - tail;
+        common = head + (fend - head < tend - head ? fend - head : tend - head);
+        for (i = head; i < common; i++) {
+            PUTC(path, '/');
+            PUTS(path, buf, (size_t)sprintf(buf, "%zu", i));
+            lept_diff_value(path, scratch, lept_array_at(from, i, &a), lept_array_at(to, i, &b), patch);
+            path->top = top;
+        }
+        // 从后往前删除，下标不会移动
+        for (i = fend; i > common; i--) {
+            PUTC(path, '/');
+            PUTS(path, buf, (size_t)sprintf(buf, "%zu", i - 1));
+            lept_diff_op(patch, "remove", path, NULL);
+            path->top = top;
+        }
+        for (i = common; i < tend; i++) {
+            PUTC(path, '/');
+            PUTS(path, buf, (size_t)sprintf(buf, "%zu", i));
+            lept_diff_op(patch, "add", path, lept_array_at(to, i, &b));
+            path->top = top;
+        }
+        return;
+    }
+    if (!lept_is_equal_value(from, to, scratch))
+        lept_diff_op(patch, "replace", path, to);
+}
+
+static void lept_diff_push_token(lept_content* path, const char* key, size_t klen) {
+    size_t i;
+    PUTC(path, '/');
+    for (i = 0; i < klen; i++) {
+        if (key[i] == '~')
+            PUTS(path, "~0", 2);
+        else if (key[i] == '/')
+            PUTS(path, "~1", 2);
+        else
+            PUTC(path, key[i]);
+    }
+}
+
+static void lept_diff_op(lept_value* patch, const char* op, const lept_content* path, const lept_value* value) {
+    lept_value* e = lept_array_insert(patch, patch->array_size);
+    lept_set_container(e, LEPT_OBJECT);
+    lept_set_string(lept_object_append(e, "op", 2), op, strlen(op));
+    lept_set_string(lept_object_append(e, "path", 4), path->top > 0 ? path->stack : "", path->top);
+    if (value != NULL)
+        lept_copy(lept_object_append(e, "value", 5), value);
+}
+
+static size_t lept_scan_string_plain_n(const char* p, size_t n) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+    for (; i + 16 <= n; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i special = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash));
+        unsigned mask;
+        special = _mm_or_si128(special, _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk));
+        if ((mask = (unsigned)_mm_movemask_epi8(special)) != 0)
+            return i + (size_t)__builtin_ctz(mask);
+    }
+#endif
+    for (; i < n; i++)
+        if (p[i] == '\"' || p[i] == '\\' || (unsigned char)p[i] < 0x20)
+            break;
+    return i;
+}
+
+static void lept_sink_init(lept_sink* s, char* buf, size_t size, lept_write_fn write, void* ctx) {
+    s->write = write;
+    s->ctx = ctx;
+    s->buf = buf;
+    s->size = size;
+    s->top = 0;
+    s->error = 0;
+}
+
+static void lept_sink_flush(lept_sink* s) {
+    if (s->top > 0 && !s->error && s->write(s->ctx, s->buf, s->top) != s->top)
+        s->error = LEPT_PARSE_WRITE_ERROR;
+    s->top = 0;
+}
+
+static void lept_sink_write(lept_sink* s, const char* data, size_t len) {
+    if (len <= s->size - s->top) {
+        memcpy(s->buf + s->top, data, len);
+        s->top += len;
+        return;
+    }
+    // 放不下时先清空缓冲区，较长的数据直接交给回调
+    lept_sink_flush(s);
+    if (len < s->size) {
+        memcpy(s->buf, data, len);
+        s->top = len;
+    }
+    else if (!s->error && s->write(s->ctx, data, len) != len)
+        s->error = LEPT_PARSE_WRITE_ERROR;
+}
+
+static void lept_sink_newline(lept_sink* s, int indent, size_t depth) {
+    static const char spaces[] = "                                ";
+    size_t n = (size_t)indent * depth;
+    LEPT_SINK_PUTC(s, '\n');
+    for (; n > sizeof(spaces) - 1; n -= sizeof(spaces) - 1)
+        lept_sink_write(s, spaces, sizeof(spaces) - 1);
+    lept_sink_write(s, spaces, n);
+}
+
+// 压缩时输出就是去掉记号之间空白后的输入，只在跳过空白时把前面的一段整体输出
+static void lept_reformat_whitespace(lept_validator* c, lept_sink* s, int indent, const char** run) {
+    const char* p = c->json;
+    lept_validate_whitespace(c);
+    if (indent == 0 && c->json != p) {
+        lept_sink_write(s, *run, (size_t)(p - *run));
+        *run = c->json;
+    }
+}
+
+// 用nest记录每一层的左括号，以循环代替递归，语法检查与lept_validate_value相同
+enum { LEPT_REFORMAT_VALUE, LEPT_REFORMAT_KEY, LEPT_REFORMAT_NEXT };
+
+static int lept_reformat_run(lept_validator* c, lept_sink* s, lept_content* nest, int indent) {
+    int ret, state = LEPT_REFORMAT_VALUE;
+    const char* start;
+    const char* run = c->json;
+    char open, close;
+    while (1) {
+        switch (state) {
+            case LEPT_REFORMAT_VALUE:
+                open = LEPT_PEEK(c);
+                if (open == '[' || open == '{') {
+                    close = open == '[' ? ']' : '}';
+                    c->json++;
+                    if (indent > 0)
+                        LEPT_SINK_PUTC(s, open);
+                    lept_reformat_whitespace(c, s, indent, &run);
+                    if (LEPT_PEEK(c) == close) {
+                        c->json++;
+                        if (indent > 0)
+                            LEPT_SINK_PUTC(s, close);
+                        state = LEPT_REFORMAT_NEXT;
+                        break;
+                    }
+                    PUTC(nest, open);
+                    if (indent > 0)
+                        lept_sink_newline(s, indent, nest->top);
+                    state = open == '[' ? LEPT_REFORMAT_VALUE : LEPT_REFORMAT_KEY;
+                    break;
+                }
+                // 标量按原样整段复制
+                start = c->json;
+                if ((ret = lept_validate_value(c)) != LEPT_PARSE_OK)
+                    return ret;
+                if (indent > 0)
+                    lept_sink_write(s, start, (size_t)(c->json - start));
+                state = LEPT_REFORMAT_NEXT;
+                break;
+            case LEPT_REFORMAT_KEY:
+                if (LEPT_PEEK(c) != '\"')
+                    return LEPT_PARSE_MISS_KEY;
+                start = c->json;
+                if ((ret = lept_validate_string(c)) != LEPT_PARSE_OK)
+                    return ret;
+                if (indent > 0)
+                    lept_sink_write(s, start, (size_t)(c->json - start));
+                lept_reformat_whitespace(c, s, indent, &run);
+                if (LEPT_PEEK(c) != ':')
+                    return LEPT_PARSE_MISS_COLON;
+                c->json++;
+                if (indent > 0)
+                    lept_sink_write(s, ": ", 2);
+                lept_reformat_whitespace(c, s, indent, &run);
+                state = LEPT_REFORMAT_VALUE;
+                break;
+            default:
+                if (nest->top == 0) {
+                    if (indent == 0)
+                        lept_sink_write(s, run, (size_t)(c->json - run));
+                    return LEPT_PARSE_OK;
+                }
+                open = nest->stack[nest->top - 1];
+                close = open == '[' ? ']' : '}';
+                lept_reformat_whitespace(c, s, indent, &run);
+                if (LEPT_PEEK(c) == ',') {
+                    c->json++;
+                    if (indent > 0) {
+                        LEPT_SINK_PUTC(s, ',');
+                        lept_sink_newline(s, indent, nest->top);
+                    }
+                    lept_reformat_whitespace(c, s, indent, &run);
+                    state = open == '[' ? LEPT_REFORMAT_VALUE : LEPT_REFORMAT_KEY;
+                }
+                else if (LEPT_PEEK(c) == close) {
+                    c->json++;
+                    nest->top--;
+                    if (indent > 0) {
+                        lept_sink_newline(s, indent, nest->top);
+                        LEPT_SINK_PUTC(s, close);
+                    }
+                }
+                else
+                    return open == '[' ? LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET : LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+                break;
+        }
+    }
+}
+
+static void lept_sink_string(lept_sink* s, const char* str, size_t len) {
+    size_t n;
+    LEPT_SINK_PUTC(s, '\"');
+    // 按缓冲区剩余空间分段转义，每个字符最多6字节
+    while (len > 0) {
+        if ((n = (s->size - s->top) / 6) == 0) {
+            lept_sink_flush(s);
+            n = s->size / 6;
+        }
+        if (n > len)
+            n = len;
+        s->top += lept_escape_string(s->buf + s->top, str, n);
+        str += n;
+        len -= n;
+    }
+    LEPT_SINK_PUTC(s, '\"');
+}
+
+static void lept_sink_number(lept_sink* s, double n) {
+    // "%.17g"会输出nan或inf，不是合法的JSON
+    if (!isfinite(n)) {
+        if (!s->error)
+            s->error = LEPT_PARSE_NOT_FINITE;
+        return;
+    }
+    if (s->size - s->top < 32)
+        lept_sink_flush(s);
+    s->top += lept_format_number(s->buf + s->top, n);
+}
+
+static void lept_writer_before_value(lept_writer* w) {
+    // 顶层只能有一个值，数组中直接写值，对象中必须先写键
+    assert(w->depth == 0 ? w->first : (LEPT_WRITER_IN(w, '[') || w->after_key));
+    if (w->after_key)
+        w->after_key = 0;
+    else if (!w->first)
+        LEPT_SINK_PUTC(&w->sink, ',');
+    w->first = 0;
+}
+
+static void lept_writer_begin(lept_writer* w, char ch) {
+    lept_writer_before_value(w);
+    LEPT_SINK_PUTC(&w->sink, ch);
+    if (w->depth < LEPT_WRITER_MAX_DEPTH)
+        w->nest[w->depth] = ch;
+    w->depth++;
+    w->first = 1;
+}
+
+static void lept_doc_free(lept_doc* doc) {
+    if (doc->owner != NULL)
+        lept_doc_release(doc->owner);
+    else
+        lept_free(&doc->v);
+    free(doc);
+}
+
+static void lept_shredder_reserve(lept_shredder* s, size_t rows) {
+    size_t i, capacity = s->capacity == 0 ? 64 : s->capacity;
+    if (rows <= s->capacity)
+        return;
+    while (capacity < rows)
+        capacity += capacity >> 1;
+    for (i = 0; i < s->column_count; i++) {
+        lept_column* col = &s->columns[i];
+        size_t width;
+        switch (col->type) {
+            case LEPT_COLUMN_NUMBER: width = sizeof(double); break;
+            case LEPT_COLUMN_INT: width = sizeof(int64_t); break;
+            case LEPT_COLUMN_BOOL: width = sizeof(unsigned char); break;
+            default: width = sizeof(size_t); break;
+        }
+        // 字符串列的offsets多一个元素
+        col->numbers = (double*)realloc(col->numbers, (capacity + 1) * width);
+        col->valid = (unsigned char*)realloc(col->valid, (capacity + 7) / 8);
+        if (col->type == LEPT_COLUMN_STRING && s->capacity == 0)
+            col->offsets[0] = 0;
+    }
+    s->capacity = capacity;
+}
+
+static int lept_shred_record(lept_shredder* s, const char* end) {
+    size_t i, row = s->rows;
+    int ret;
+    lept_shredder_reserve(s, row + 1);
+    // 先把这一行记为无效，匹配到的值再覆盖
+    for (i = 0; i < s->column_count; i++) {
+        lept_column* col = &s->columns[i];
+        if ((row & 7) == 0)
+            col->valid[row >> 3] = 0;
+        else
+            col->valid[row >> 3] &= (unsigned char)~(1u << (row & 7));
+        switch (col->type) {
+            case LEPT_COLUMN_NUMBER: col->numbers[row] = 0.0; break;
+            case LEPT_COLUMN_INT: col->ints[row] = 0; break;
+            case LEPT_COLUMN_BOOL: col->bools[row] = 0; break;
+            default: col->offsets[row + 1] = col->offsets[row]; break;
+        }
+        s->candidates[i * 2] = i;
+        s->candidates[i * 2 + 1] = 1;
+        s->seen[i] = 0;
+    }
+    if (*s->c.json != '{')
+        return LEPT_PARSE_TYPE_MISMATCH;
+    if ((ret = lept_shred_object(s, end, s->column_count)) != LEPT_PARSE_OK) {
+        // 丢弃这一行已经写入的字符串
+        for (i = 0; i < s->column_count; i++)
+            if (s->columns[i].type == LEPT_COLUMN_STRING)
+                s->columns[i].chars_size = s->columns[i].offsets[row];
+        return ret;
+    }
+    s->rows++;
+    return LEPT_PARSE_OK;
+}
+
+// candidates的前count项是当前对象中的候选列，片段位置指向这一层的键
+// 与键相同的候选交换到前面并前进一层，作为下一层的候选，处理完这个值后再退回
+static int lept_shred_object(lept_shredder* s, const char* end, size_t count) {
+    lept_content* c = &s->c;
+    size_t* cand = s->candidates;
+    size_t i, j, key_len, matched;
+    lept_column* leaf;
+    char* key;
+    int ret;
+    c->json++;
+    lept_parse_whitespace(c);
+    if (*c->json == '}') {
+        c->json++;
+        return LEPT_PARSE_OK;
+    }
+    while (1) {
+        if (*c->json != '\"')
+            return LEPT_PARSE_MISS_KEY;
+        if ((ret = lept_parse_string_raw(c, &key, &key_len)) != LEPT_PARSE_OK)
+            return ret;
+        // 路径在此结束的列接收这个值
+        leaf = NULL;
+        for (i = 0, matched = 0; i < count; i++) {
+            lept_column* col = &s->columns[cand[i * 2]];
+            size_t pos = cand[i * 2 + 1], next;
+            const char* slash = (const char*)memchr(col->path + pos, '/', col->path_len - pos);
+            next = slash != NULL ? (size_t)(slash - col->path) : col->path_len;
+            if (s->seen[cand[i * 2]] || !lept_token_equal(col->path + pos, next - pos, key, key_len))
+                continue;
+            if (next == col->path_len) {
+                leaf = col;
+                continue;
+            }
+            for (j = 0; j < 2; j++) {
+                size_t t = cand[matched * 2 + j];
+                cand[matched * 2 + j] = cand[i * 2 + j];
+                cand[i * 2 + j] = t;
+            }
+            cand[matched * 2 + 1] = next + 1;
+            matched++;
+        }
+        lept_parse_whitespace(c);
+        if (*c->json != ':')
+            return LEPT_PARSE_MISS_COLON;
+        c->json++;
+        lept_parse_whitespace(c);
+        if (leaf != NULL)
+            ret = lept_shred_value(s, leaf);
+        else if (matched > 0 && *c->json == '{')
+            ret = lept_shred_object(s, end, matched);
+        else {
+            // 没有列经过这个值，或者路径上的值不是对象：只校验并跳过
+            lept_validator v;
+            v.json = c->json;
+            v.end = end;
+            ret = lept_validate_value(&v);
+            c->json = v.json;
+        }
+        // 之后同名的键不再匹配这些列，即使这个值是null或不是对象
+        if (leaf != NULL)
+            s->seen[leaf - s->columns] = 1;
+        // 恢复下一个键要用的片段位置
+        for (i = 0; i < matched; i++) {
+            s->seen[cand[i * 2]] = 1;
+            size_t pos = cand[i * 2 + 1] - 1;
+            while (s->columns[cand[i * 2]].path[pos - 1] != '/')
+                pos--;
+            cand[i * 2 + 1] = pos;
+        }
+        if (ret != LEPT_PARSE_OK)
+            return ret;
+        lept_parse_whitespace(c);
+        if (*c->json == ',') {
+            c->json++;
+            lept_parse_whitespace(c);
+        }
+        else if (*c->json == '}') {
+            c->json++;
+            return LEPT_PARSE_OK;
+        }
+        else
+            return LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+    }
+}
+
+static int lept_shred_value(lept_shredder* s, lept_column* col) {
+    lept_content* c = &s->c;
+    size_t row = s->rows, len;
+    char* str;
+    lept_value e;
+    int ret;
+    if (*c->json == 'n') {
+        lept_init(&e);
+        return lept_parse_literal(c, &e, "null", LEPT_NULL);
+    }
+    switch (col->type) {
+        case LEPT_COLUMN_NUMBER:
+            if (*c->json != '-' && !ISDIGIT(*c->json))
+                return LEPT_PARSE_TYPE_MISMATCH;
+            if ((ret = lept_parse_number(c, &e)) != LEPT_PARSE_OK)
+                return ret;
+            col->numbers[row] = e.n;
+            break;
+        case LEPT_COLUMN_INT:
+            if (*c->json != '-' && !ISDIGIT(*c->json))
+                return LEPT_PARSE_TYPE_MISMATCH;
+            if ((ret = lept_parse_int64(c, &col->ints[row])) != LEPT_PARSE_OK)
+                return ret;
+            break;
+        case LEPT_COLUMN_BOOL:
+            if (*c->json == 't')
+                ret = lept_parse_literal(c, &e, "true", LEPT_TRUE);
+            else if (*c->json == 'f')
+                ret = lept_parse_literal(c, &e, "false", LEPT_FALSE);
+            else
+                return LEPT_PARSE_TYPE_MISMATCH;
+            if (ret != LEPT_PARSE_OK)
+                return ret;
+            col->bools[row] = e.type == LEPT_TRUE;
+            break;
+        default:
+            if (*c->json != '\"')
+                return LEPT_PARSE_TYPE_MISMATCH;
+            // 解码在栈上，出栈后追加到chars
+            if ((ret = lept_parse_string_raw(c, &str, &len)) != LEPT_PARSE_OK)
+                return ret;
+            assert(col->chars_size == col->offsets[row]);
+            if (col->chars_size + len > col->chars_cap) {
+                col->chars_cap = col->chars_cap == 0 ? 256 : col->chars_cap;
+                while (col->chars_size + len > col->chars_cap)
+                    col->chars_cap += col->chars_cap >> 1;
+                col->chars = (char*)realloc(col->chars, col->chars_cap);
+            }
+            memcpy(col->chars + col->chars_size, str, len);
+            col->chars_size += len;
+            col->offsets[row + 1] = col->chars_size;
+            break;
+    }
+    col->valid[row >> 3] |= (unsigned char)(1u << (row & 7));
+    return LEPT_PARSE_OK;
 }
@@ -3,6 +3,8 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
 
 // 用于判断json类型是否是期望类型
 #define EXPECT(c, ch) do { assert(*c->json == (ch)); } while (0)
@@ -22,38 +24,192 @@ typedef struct {
     const char* json;
     char* stack; // 缓冲区
     size_t size, top; // 栈大小以及栈顶
+    int flags; // 解析选项
 } lept_content;
 
+// 只校验不建树时的状态，输入不要求以'\0'结尾
+typedef struct {
+    const char* json;
+    const char* end;
+} lept_validator;
+
 typedef struct lept_value lept_value;
 typedef struct lept_member lept_member;
 
+// 输出回调，返回实际写入的字节数，小于len时视为出错
+typedef size_t (*lept_write_fn)(void* ctx, const char* data, size_t len);
+
+// 带缓冲的输出，缓冲区满时交给write回调
+typedef struct {
+    lept_write_fn write;
+    void* ctx;
+    char* buf;
+    size_t size, top;
+    int error; // 出错后记录第一个错误码，之后的输出都被丢弃
+} lept_sink;
+
+// 调试版检查嵌套时记录的最大层数，更深的层不检查
+#ifndef LEPT_WRITER_MAX_DEPTH
+#define LEPT_WRITER_MAX_DEPTH 64
+#endif
+
+// 流式写出json，不建树，内存占用只有调用者提供的缓冲区
+typedef struct {
+    lept_sink sink;
+    size_t depth; // 当前嵌套层数
+    int first; // 当前层还没有写过元素，不需要逗号
+    int after_key; // 刚写完键，接下来必须是值
+    char nest[LEPT_WRITER_MAX_DEPTH]; // 每一层的左括号
+} lept_writer;
+
+// 逐个读取顶层数组元素的游标
+typedef struct {
+    FILE* fp; // 文件来源，内存来源时为NULL
+    char* buf; // 文件来源时的读入窗口，总是以'\0'结尾
+    size_t cap; // 窗口容量，随最大的元素增长
+    const char* json; // 当前位置
+    const char* end; // 已读入数据的结尾
+    int eof; // 已读到输入结尾
+    int state; // 见lept_array_cursor_next
+    int ret; // 出错后保存错误码
+    lept_content c; // 解析缓冲区，在元素之间复用
+} lept_array_cursor;
+
+// 结构体绑定：由字段描述表直接把json对象解析到C结构体中，不经过lept_value树
+typedef enum {
+    LEPT_FIELD_NUMBER, // double
+    LEPT_FIELD_INT, // int64_t，数值必须是整数
+    LEPT_FIELD_BOOL, // int
+    LEPT_FIELD_STRING, // char*，以'\0'结尾，由lept_bind_free释放
+    LEPT_FIELD_OBJECT // 嵌套结构体
+} lept_field_type;
+
+typedef struct lept_struct_desc lept_struct_desc;
+
+typedef struct {
+    const char* name; // json中的键
+    size_t name_len;
+    size_t offset; // 字段在结构体中的偏移
+    lept_field_type type;
+    lept_struct_desc* desc; // 只在LEPT_FIELD_OBJECT时有意义
+    uint64_t hash; // 键的哈希，由lept_bind_prepare计算
+} lept_field;
+
+struct lept_struct_desc {
+    lept_field* fields;
+    size_t field_count;
+    int prepared;
+};
+
+#define LEPT_FIELD_NAMED(type, member, name, kind) \
+    { name, sizeof(name) - 1, offsetof(type, member), kind, NULL, 0 }
+#define LEPT_FIELD(type, member, kind) LEPT_FIELD_NAMED(type, member, #member, kind)
+#define LEPT_FIELD_STRUCT(type, member, nested) \
+    { #member, sizeof(#member) - 1, offsetof(type, member), LEPT_FIELD_OBJECT, &(nested), 0 }
+#define LEPT_STRUCT_DESC(fields) { fields, sizeof(fields) / sizeof((fields)[0]), 0 }
+
+// 列式拆分：把一批NDJSON记录直接解析到按列存储的缓冲区中，不经过lept_value树
+typedef enum {
+    LEPT_COLUMN_NUMBER, // double
+    LEPT_COLUMN_INT, // int64_t，数值必须是整数
+    LEPT_COLUMN_BOOL, // unsigned char，0或1
+    LEPT_COLUMN_STRING // offsets[i]到offsets[i + 1]是第i行在chars中的内容，不以'\0'结尾
+} lept_column_type;
+
+typedef struct {
+    const char* path; // JSON Pointer，只能经过对象，如"/user/id"，各列路径不能相同，也不能是另一列路径的前缀
+    lept_column_type type;
+    size_t path_len; // 以下由lept_shredder_init设置
+    union {
+        double* numbers;
+        int64_t* ints;
+        unsigned char* bools;
+        size_t* offsets; // 比行数多一个元素
+    };
+    char* chars; // 字符串列的内容
+    size_t chars_size, chars_cap;
+    unsigned char* valid; // 有效位图，第i行的值缺失或为null时第i位为0
+} lept_column;
+
+#define LEPT_COLUMN(path, type) { path, type, 0, { NULL }, NULL, 0, 0, NULL }
+#define LEPT_COLUMN_IS_VALID(col, row) (((col)->valid[(row) >> 3] >> ((row) & 7)) & 1)
+
+typedef struct {
+    lept_column* columns;
+    size_t column_count;
+    size_t rows; // 已经拆分的行数
+    size_t capacity; // 每列已分配的行数
+    size_t* candidates; // 每层对象中可能匹配的列及其下一个路径片段的位置
+    unsigned char* seen; // 当前记录中已经遇到过路径上的键的列，重复的键以第一次为准
+    lept_content c; // 解码字符串的栈，在批次之间复用
+} lept_shredder;
+
+// 并行解析时一个线程负责的一段连续数组元素
+typedef struct {
+    const char* json; // 第一个元素的起始位置
+    lept_value* out; // 结果写入的位置
+    size_t count; // 元素个数
+    int flags;
+    int ret;
+    int started; // 是否在新线程中运行
+} lept_parse_task;
+
+// 定义LEPT_COMPACT_NODE时使用压缩布局：长度用32位存储，类型用1字节存储
+// lept_value从24字节缩小到16字节，lept_member从40字节缩小到32字节
+#ifdef LEPT_COMPACT_NODE
+typedef uint32_t lept_size;
+typedef unsigned char lept_type_tag;
+#define LEPT_SIZE_MAX UINT32_MAX
+#else
+typedef size_t lept_size;
+typedef lept_type lept_type_tag;
+#define LEPT_SIZE_MAX SIZE_MAX
+#endif
+
 // json解析树节点
 struct lept_value {
     union {
-        struct {
-            lept_member* object;
-            size_t object_size;
-        };
-        struct {
-            lept_value* array;
-            size_t array_size;
-        };
-        struct {
-            char* s;
-            size_t len;
-        }; // useful only when type --> LEPT_STRING
+        lept_member* object; // useful only when type --> LEPT_OBJECT
+        lept_value* array; // useful only when type --> LEPT_ARRAY
+        double* numbers; // useful only when type --> LEPT_ARRAY and packed
+        char* s; // useful only when type --> LEPT_STRING
         double n; // useful only when type --> LEPT_NUMBER
     };
-    lept_type type;
+    union {
+        lept_size object_size;
+        lept_size array_size;
+        lept_size len;
+    };
+    lept_type_tag type;
+    unsigned char packed; // 数组元素全为数字且以double连续存储，只在LEPT_ARRAY时有意义
 };
 
 // 对象的键值对
 struct lept_member {
     char* key;
-    size_t key_len;
+    lept_size key_len;
     lept_value v;
 };
 
+// 补丁的撤销记录，失败时按相反顺序回滚
+// 节点用路径记录而不是指针，之后的操作可能让上层容器扩容而移动
+typedef enum {
+    LEPT_UNDO_SET, // path处的值被替换，old是原来的值
+    LEPT_UNDO_INSERTED, // 在path处的容器第index个位置插入了值
+    LEPT_UNDO_REMOVED, // 移除了path处的容器第index个值，对象成员的键保存在key中
+    LEPT_UNDO_UNPACK // path处紧凑存储的数组被展开
+} lept_undo_type;
+
+typedef struct {
+    const char* path; // 指向补丁中的路径，补丁在回滚之后才释放
+    size_t len, index;
+    lept_undo_type type;
+    int moved; // move操作的值已移到新位置，回滚时取回上一步被替换出来的值，而不是old
+    char* key;
+    size_t key_len;
+    lept_value old;
+} lept_patch_undo;
+
 // 解析函数返回值
 // 在非法值错误和空格后面还有值之间优先返回非法值错误
 enum {
@@ -70,11 +226,104 @@ enum {
     LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET,
     LEPT_PARSE_MISS_KEY,
     LEPT_PARSE_MISS_COLON,
-    LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET
+    LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET,
+    LEPT_PARSE_FILE_ERROR, // 无法打开或映射文件
+    LEPT_PARSE_INVALID_UTF8, // 字符串中有不合法的UTF-8字节序列
+    LEPT_PARSE_TOO_LONG, // 字符串、数组或对象长度超出lept_size范围(仅压缩布局)
+    LEPT_PARSE_NOT_ARRAY, // 游标要求顶层是数组
+    LEPT_PARSE_TYPE_MISMATCH, // 绑定结构体时json值类型与字段类型不符
+    LEPT_PARSE_WRITE_ERROR, // 输出回调写入的字节数不足
+    LEPT_PARSE_NOT_FINITE // 要写出的数字是NaN或无穷大，JSON中无法表示
+};
+
+// lept_array_cursor_next在数组结束时的返回值
+#define LEPT_ARRAY_CURSOR_END (-1)
+// 文件来源每次读入的字节数
+#ifndef LEPT_CURSOR_CHUNK
+#define LEPT_CURSOR_CHUNK 65536
+#endif
+
+// 解析选项，可按位组合
+enum {
+    LEPT_PARSE_DEFAULT = 0,
+    LEPT_PARSE_FILE_POPULATE = 1 << 0, // 映射文件时预先读入全部页面
+    LEPT_PARSE_VALIDATE_UTF8 = 1 << 1, // 严格检查字符串中的原始字节是否为合法UTF-8
+    LEPT_PARSE_PACK_NUMBERS = 1 << 2 // 元素全为数字的数组以double数组紧凑存储
 };
 
 // 主要解析函数
 int lept_parse(lept_value* v, const char* json);
+// 带解析选项的版本
+int lept_parse_ex(lept_value* v, const char* json, int flags);
+// 顶层为数组时，按元素划分后用threads个线程并行解析，结果与lept_parse_ex完全相同
+// 其他情况或输入不合法时退回单线程解析
+int lept_parse_parallel(lept_value* v, const char* json, int flags, int threads);
+// 通过mmap直接解析文件内容，不需要读入缓冲区，也不要求以'\0'结尾
+int lept_parse_file(lept_value* v, const char* path, int flags);
+// 游标：每次解析顶层数组的一个元素，内存占用只与最大的元素有关
+// 打开内存中以'\0'结尾的json，成功时返回LEPT_PARSE_OK
+int lept_array_cursor_open(lept_array_cursor* cur, const char* json, int flags);
+// 打开文件，分块读入
+int lept_array_cursor_open_file(lept_array_cursor* cur, const char* path, int flags);
+// 解析下一个元素存入elem，elem必须已初始化，原有内容会被释放
+// 返回LEPT_PARSE_OK，数组结束时返回LEPT_ARRAY_CURSOR_END，出错时返回错误码
+int lept_array_cursor_next(lept_array_cursor* cur, lept_value* elem);
+void lept_array_cursor_close(lept_array_cursor* cur);
+
+// 结构体绑定
+// 计算描述表中键的哈希，多线程共用同一个描述表前须先调用一次
+void lept_bind_prepare(lept_struct_desc* desc);
+// 将以'\0'结尾的json对象解析到obj中，obj须先清零或是之前绑定过的结构体
+// 未知的键直接跳过，值为null的字段保持不变，出错时已经写入的字段仍需lept_bind_free
+int lept_bind_parse(lept_struct_desc* desc, void* obj, const char* json);
+// 将obj按描述表写成json，返回值需要free，length可为NULL
+// 数字字段是NaN或无穷大时无法写成JSON，返回NULL
+char* lept_bind_stringify(const lept_struct_desc* desc, const void* obj, size_t* length);
+// 释放obj中的字符串字段
+void lept_bind_free(const lept_struct_desc* desc, void* obj);
+
+// 列式拆分
+// columns由调用者提供并在lept_shredder_free之前保持有效，调试版会断言路径互不为前缀
+void lept_shredder_init(lept_shredder* s, lept_column* columns, size_t column_count);
+// 把以'\0'结尾的一批记录追加到各列中，记录是以空白分隔的json对象
+// 缺失或为null的值记为无效，值的类型与列不符时返回LEPT_PARSE_TYPE_MISMATCH
+// 与lept_find_object_value相同，重复的键以第一次出现为准，之后的只校验
+// 出错时出错的记录不会留下任何内容，之前的记录仍然保留
+int lept_shred(lept_shredder* s, const char* json);
+// 清空所有列但保留已分配的缓冲区，供下一批复用
+void lept_shredder_clear(lept_shredder* s);
+void lept_shredder_free(lept_shredder* s);
+
+// 只检查json[0, len)是否合法，返回值与lept_parse相同，不分配任何内存
+// 出错时若err_offset不为NULL，写入出错位置相对json的偏移
+int lept_validate(const char* json, size_t len, size_t* err_offset);
+
+// 不建树，逐个记号地把json[0, len)重新排版后交给write输出，内存占用与输入大小无关
+// indent为0时去掉所有空白，大于0时每层缩进indent个空格，字符串和数字按原样复制
+// 返回值与lept_validate相同，回调出错时返回LEPT_PARSE_WRITE_ERROR，出错前已输出的内容不会撤回
+int lept_reformat(const char* json, size_t len, int indent, lept_write_fn write, void* ctx);
+// 通过mmap读取文件后重新排版
+int lept_reformat_file(const char* path, int indent, lept_write_fn write, void* ctx);
+
+// 流式写出，转义与数字格式和lept_bind_stringify相同
+// buf为输出缓冲区，size至少为64字节，写满后交给write回调
+void lept_writer_init(lept_writer* w, char* buf, size_t size, lept_write_fn write, void* ctx);
+void lept_writer_begin_object(lept_writer* w);
+void lept_writer_end_object(lept_writer* w);
+void lept_writer_begin_array(lept_writer* w);
+void lept_writer_end_array(lept_writer* w);
+// 对象中每个值之前必须先写键
+void lept_writer_key(lept_writer* w, const char* key, size_t len);
+void lept_writer_string(lept_writer* w, const char* s, size_t len);
+void lept_writer_number(lept_writer* w, double n);
+void lept_writer_int(lept_writer* w, int64_t n);
+void lept_writer_boolean(lept_writer* w, int b);
+void lept_writer_null(lept_writer* w);
+// 写出整棵树
+void lept_writer_value(lept_writer* w, const lept_value* v);
+// 写出缓冲区中剩余的内容，返回LEPT_PARSE_OK或第一个错误:
+// 回调出错时为LEPT_PARSE_WRITE_ERROR，写过NaN或无穷大时为LEPT_PARSE_NOT_FINITE
+int lept_writer_finish(lept_writer* w);
 
 // 释放lept内部变量，并将类型置为NULL
 void lept_free(lept_value* v); 
@@ -101,15 +350,91 @@ void lept_set_string(lept_value* v, const char* c, size_t len);
 
 // array类型函数
 size_t lept_get_array_size(const lept_value* v);
+// 数组不能是紧凑存储的，紧凑数组用lept_get_array_number读取，或先调用lept_unpack_array
 lept_value* lept_get_array_element(const lept_value* v, size_t index);
+// 第index个元素必须是数字，对紧凑存储的数组也不做任何修改
+double lept_get_array_number(const lept_value* v, size_t index);
+// 把紧凑存储的数组展开为lept_value数组，之前由lept_get_number_array得到的指针失效
+void lept_unpack_array(lept_value* v);
+// 数组紧凑存储时返回double数组首地址并写入元素个数，否则返回NULL
+const double* lept_get_number_array(const lept_value* v, size_t* size);
 
 // object类型函数
 size_t lept_get_object_size(const lept_value* v);
 const char* lept_get_object_key(const lept_value* v, size_t index);
 size_t lept_get_object_key_length(const lept_value* v, size_t index);
 lept_value* lept_get_object_value(const lept_value* v, size_t index);
+// 按键查找成员，重复的键返回第一个，找不到时返回LEPT_KEY_NOT_EXIST/NULL
+#define LEPT_KEY_NOT_EXIST ((size_t)-1)
+size_t lept_find_object_index(const lept_value* v, const char* key, size_t klen);
+lept_value* lept_find_object_value(const lept_value* v, const char* key, size_t klen);
+
+// 深拷贝src到dst
+void lept_copy(lept_value* dst, const lept_value* src);
+// 将src的内容移动到dst，src变为null
+void lept_move(lept_value* dst, lept_value* src);
+void lept_swap(lept_value* lhs, lept_value* rhs);
+
+// 结构相等比较，对象与键的顺序无关，重复的键以第一次出现为准
+int lept_is_equal(const lept_value* lhs, const lept_value* rhs);
+// 64位结构哈希，相等的值哈希相同，可作为哈希表的键
+uint64_t lept_hash(const lept_value* v);
+
+// 补丁函数返回值
+enum {
+    LEPT_PATCH_OK,
+    LEPT_PATCH_INVALID, // 补丁格式不正确
+    LEPT_PATCH_PATH_NOT_FOUND, // 路径不存在
+    LEPT_PATCH_TEST_FAILED // test操作比较失败
+};
+
+// 原地应用RFC 7386 JSON Merge Patch，patch中的子树被移动到target中，patch最终变为null
+void lept_merge_patch(lept_value* target, lept_value* patch);
+// 原地应用RFC 6902 JSON Patch，patch为操作数组，其中的值被移动到target中，patch最终变为null
+// 按顺序执行，任何一个操作出错时撤销之前的操作，target保持不变
+int lept_apply_patch(lept_value* target, lept_value* patch);
+// 生成从from变为to的JSON Patch，写入patch
+void lept_diff(const lept_value* from, const lept_value* to, lept_value* patch);
+
+// 解析缓存：以输入内容的哈希为键的LRU缓存，命中时返回共享的只读值
+// 所有函数都可以被多个线程同时调用
+typedef struct lept_cache lept_cache;
+
+typedef struct {
+    size_t hits, misses, evictions; // 命中、未命中、淘汰次数
+    size_t entries, memory; // 当前缓存的条目数与占用内存(字节)
+} lept_cache_stats;
+
+// max_entries为最大条目数，max_memory为内存上限(字节)，0表示不限
+lept_cache* lept_cache_create(size_t max_entries, size_t max_memory);
+// 销毁缓存，仍被持有的值在最后一次lept_cache_release时释放
+void lept_cache_destroy(lept_cache* cache);
+// 解析json，失败时返回NULL，解析结果写入ret(可为NULL)
+// 返回值不可修改，用完后必须调用lept_cache_release
+const lept_value* lept_cache_parse(lept_cache* cache, const char* json, int* ret);
+void lept_cache_release(const lept_value* v);
+void lept_cache_get_stats(lept_cache* cache, lept_cache_stats* stats);
+
+// 只读共享文档：冻结后的树不再修改，多个线程可以不加锁同时读取
+// 文档和子树句柄都带有原子引用计数，子树句柄持有整个文档
+typedef struct lept_doc lept_doc;
+
+// 把v的整棵树移入新文档，不复制，v变为null，返回的句柄引用计数为1
+lept_doc* lept_freeze(lept_value* v);
+const lept_value* lept_doc_root(const lept_doc* doc);
+lept_doc* lept_doc_retain(lept_doc* doc);
+void lept_doc_release(lept_doc* doc);
+// 返回以node为根的子树句柄，node必须属于doc，用完后调用lept_doc_release
+lept_doc* lept_doc_subtree(lept_doc* doc, const lept_value* node);
+// 写时复制：把doc的内容写入v并释放doc的一个引用
+// doc是整个文档的唯一引用时直接取出树，否则深拷贝
+void lept_doc_thaw(lept_doc* doc, lept_value* v);
+
+// static function，只有leptjson.c定义LEPTJSON_IMPL后才可见，测试和其他使用者包含时不会得到未定义的static声明
+#ifdef LEPTJSON_IMPL
+// 解析json并返回解析结束的位置
+static int lept_parse_json(lept_value* v, const char* json, int flags, const char** end);
 
-// static function
 static void lept_parse_whitespace(lept_content* c);
 
 static int lept_parse_value(lept_content* c, lept_value* v);
@@ -122,6 +447,10 @@ static int lept_parse_number(lept_content* c, lept_value* v);
 static int lept_parse_string_raw(lept_content* c, char** str, size_t* size);
 // 将raw获取的字符串及其长度存入lept_value中
 static int lept_parse_string(lept_content* c, lept_value* v);
+// 返回从p开始不需要特殊处理的字节数(不含引号、反斜杠、控制字符，strict时也不含非ASCII字节)
+static size_t lept_scan_string_plain(const char* p, int strict);
+// 返回从p开始的合法UTF-8多字节序列长度，不合法时返回0
+static size_t lept_utf8_sequence(const unsigned char* p);
 
 // 第一次分配缓存空间时的大小
 #ifndef LEPT_PARSE_STACK_INIT_LENGTH
@@ -141,4 +470,169 @@ static int lept_parse_array(lept_content* c, lept_value* v);
 
 static int lept_parse_object(lept_content* c, lept_value* v);
 
+// 结构体绑定相关
+static int lept_bind_object(lept_content* c, const char* end, lept_struct_desc* desc, char* obj);
+static int lept_bind_field(lept_content* c, const char* end, const lept_field* f, char* obj);
+// 数字字段是NaN或无穷大时返回LEPT_PARSE_NOT_FINITE，已写入c的内容由调用者丢弃
+static int lept_bind_write(lept_content* c, const lept_struct_desc* desc, const char* obj);
+// 解析int64_t范围内的整数写入out，纯整数只扫描一遍，1.0、1e3这样的写法才交给lept_parse_number
+// 不是整数或越界时返回LEPT_PARSE_TYPE_MISMATCH，结构体绑定和列式拆分共用
+static int lept_parse_int64(lept_content* c, int64_t* out);
+
+// 修改树的辅助函数
+static void lept_set_container(lept_value* v, lept_type type);
+// 在对象末尾添加成员，key被复制，返回新成员的值(null)
+static lept_value* lept_object_append(lept_value* v, const char* key, size_t klen);
+static void lept_object_remove(lept_value* v, size_t index);
+// 在数组index处插入一个null元素并返回它
+static lept_value* lept_array_insert(lept_value* v, size_t index);
+static void lept_array_erase(lept_value* v, size_t index);
+
+// JSON Pointer(RFC 6901)与补丁相关
+// 比较转义过的路径片段与键是否相同
+static int lept_token_equal(const char* t, size_t tlen, const char* key, size_t klen);
+// 还原路径片段中的~0和~1，out至少tlen字节，返回还原后的长度
+static size_t lept_token_unescape(const char* t, size_t tlen, char* out);
+// 路径为空或以'/'开头，并且每个~后面都是0或1时返回1
+static int lept_pointer_valid(const char* ptr, size_t len);
+// 路径片段是合法的数组下标时返回1
+static int lept_token_index(const char* t, size_t tlen, size_t* index);
+static lept_value* lept_pointer_child(lept_value* v, const char* t, size_t tlen);
+// 途经的数组会被展开并记入log，log为NULL时路径上不能有紧凑存储的数组
+static lept_value* lept_pointer_resolve(lept_value* root, const char* ptr, size_t len, lept_content* log);
+// 在log中追加一条撤销记录，返回的指针在下一次追加前有效
+static lept_patch_undo* lept_patch_log(lept_content* log, lept_undo_type type, const char* path, size_t len, size_t index);
+static void lept_patch_unpack(lept_value* v, const char* path, size_t len, lept_content* log);
+static int lept_patch_add(lept_value* root, const char* path, size_t len, lept_value* value, lept_content* log);
+static int lept_patch_remove(lept_value* root, const char* path, size_t len, lept_value* removed, lept_content* log);
+static int lept_patch_op(lept_value* root, lept_value* op, lept_content* log);
+// 撤销log中的全部操作，log为空时root恢复为应用补丁之前的样子
+static void lept_patch_rollback(lept_value* root, lept_content* log);
+// scratch上存放对象的键索引，与lept_is_equal_value共用
+static void lept_diff_value(lept_content* path, lept_content* scratch, const lept_value* from, const lept_value* to, lept_value* patch);
+static void lept_diff_push_token(lept_content* path, const char* key, size_t klen);
+static void lept_diff_op(lept_value* patch, const char* op, const lept_content* path, const lept_value* value);
+
+// 序列化
+#define PUTS(c, s, len) memcpy(lept_content_push(c, len), s, len)
+static void lept_stringify_string(lept_content* c, const char* s, size_t len);
+static void lept_stringify_number(lept_content* c, double n);
+// 转义s[0, len)写入out(不含引号)，out至少len * 6字节，返回写入的长度
+static size_t lept_escape_string(char* out, const char* s, size_t len);
+// 数字格式化写入buf，buf至少32字节，返回写入的长度
+static size_t lept_format_number(char* buf, double n);
+
+// 游标相关
+static int lept_cursor_open(lept_array_cursor* cur, int flags);
+// 进入出错状态，之后的调用都返回ret
+static int lept_cursor_error(lept_array_cursor* cur, int ret);
+// 读入更多数据，没有更多数据时返回0
+static int lept_cursor_fill(lept_array_cursor* cur);
+// 跳过空白，必要时读入更多数据
+static void lept_cursor_whitespace(lept_array_cursor* cur);
+// 保证从当前位置开始的整个值及其后的分隔符都已读入
+static void lept_cursor_ensure_value(lept_array_cursor* cur);
+
+// 并行解析相关
+// 不做校验地跳过一个值，只识别字符串、转义和括号嵌套，到达end仍未结束时返回NULL
+static const char* lept_skip_value(const char* p, const char* end);
+static void* lept_parse_task_run(void* arg);
+
+// 紧凑数组相关
+// 将紧凑存储的数组展开为lept_value数组
+static void lept_array_unpack(lept_value* v);
+// 把元素全是数字的数组改回紧凑存储
+static void lept_array_pack(lept_value* v);
+static int lept_pack_numbers(lept_content* c, lept_value* v);
+// 返回数组第index个元素，紧凑存储时把数字放进temp中返回，不修改数组
+static const lept_value* lept_array_at(const lept_value* v, size_t index, lept_value* temp);
+// 数组第index个元素是数字时写入d并返回1
+static int lept_array_number_at(const lept_value* v, size_t index, double* d);
+
+// 校验函数，语法与错误码和上面的解析函数一一对应
+// 读到end时视为遇到'\0'
+#define LEPT_PEEK(c) ((c)->json < (c)->end ? *(c)->json : '\0')
+
+static void lept_validate_whitespace(lept_validator* c);
+static int lept_validate_value(lept_validator* c);
+static int lept_validate_literal(lept_validator* c, const char* literal);
+static int lept_validate_number(lept_validator* c);
+static int lept_validate_hex4(lept_validator* c, unsigned* u);
+static int lept_validate_string(lept_validator* c);
+static int lept_validate_array(lept_validator* c);
+static int lept_validate_object(lept_validator* c);
+// 判断[start, end)中的数字是否超出double范围，不要求以'\0'结尾
+static int lept_number_too_big(const char* start, const char* end);
+// 返回[p, p + n)开头不需要特殊处理的字节数，不会读到p + n之后
+static size_t lept_scan_string_plain_n(const char* p, size_t n);
+
+// 映射文件，文件内容之后至少有一个'\0'，用munmap(*base, *total)释放
+static int lept_map_file(const char* path, int flags, char** base, size_t* size, size_t* total);
+
+// 输出缓冲相关
+#ifndef LEPT_SINK_BUFFER_SIZE
+#define LEPT_SINK_BUFFER_SIZE 16384
+#endif
+#define LEPT_SINK_PUTC(s, ch) \
+    do { \
+        if ((s)->top == (s)->size) \
+            lept_sink_flush(s); \
+        (s)->buf[(s)->top++] = (ch); \
+    } while (0)
+
+static void lept_sink_init(lept_sink* s, char* buf, size_t size, lept_write_fn write, void* ctx);
+static void lept_sink_flush(lept_sink* s);
+static void lept_sink_write(lept_sink* s, const char* data, size_t len);
+// 换行并缩进depth层
+static void lept_sink_newline(lept_sink* s, int indent, size_t depth);
+static void lept_reformat_whitespace(lept_validator* c, lept_sink* s, int indent, const char** run);
+static int lept_reformat_run(lept_validator* c, lept_sink* s, lept_content* nest, int indent);
+static void lept_sink_string(lept_sink* s, const char* str, size_t len);
+static void lept_sink_number(lept_sink* s, double n);
+
+// 流式写出相关
+// 当前层是数组或对象，超过LEPT_WRITER_MAX_DEPTH的层不检查
+#define LEPT_WRITER_IN(w, ch) \
+    ((w)->depth > 0 && ((w)->depth > LEPT_WRITER_MAX_DEPTH || (w)->nest[(w)->depth - 1] == (ch)))
+// 写值之前检查位置并补上逗号
+static void lept_writer_before_value(lept_writer* w);
+static void lept_writer_begin(lept_writer* w, char ch);
+
+// 哈希相关
+#define LEPT_HASH_PRIME 0x9E3779B97F4A7C15ULL
+#define LEPT_HASH_SEED(type) (((uint64_t)(type) + 1) * 0xD6E8FEB86659FD93ULL)
+
+static uint64_t lept_hash_mix(uint64_t h);
+static uint64_t lept_load64(const unsigned char* p);
+static uint64_t lept_hash_bytes(const void* data, size_t len, uint64_t seed);
+static uint64_t lept_hash_number(double d);
+// 比较和哈希的递归版本，索引都建在scratch栈上，一次调用最多分配一次缓冲区
+static int lept_is_equal_value(const lept_value* lhs, const lept_value* rhs, lept_content* scratch);
+static uint64_t lept_hash_value(const lept_value* v, lept_content* scratch);
+// 对象中重复的键以第一次出现为准
+// 成员较多时在scratch栈顶为v建立键到第一次出现的哈希索引，返回它在栈中的偏移，mask为0表示没有建索引
+// distinct写入不同键的个数，用完后用lept_object_index_free按相反顺序出栈
+static size_t lept_object_index(const lept_value* v, lept_content* scratch, size_t* mask, size_t* distinct);
+static void lept_object_index_free(lept_content* scratch, size_t mask);
+// 取得索引的地址，栈扩容后会变化，递归之后要重新取
+#define LEPT_SCRATCH_SLOTS(scratch, offset, mask) ((mask) != 0 ? (const size_t*)((scratch)->stack + (offset)) : NULL)
+// 查找键第一次出现的成员，slots为NULL时线性查找
+static const lept_member* lept_object_first(const lept_value* v, const size_t* slots, size_t mask, const char* key, size_t klen);
+static int lept_is_equal_object(const lept_value* lhs, const lept_value* rhs, lept_content* scratch);
+
+// 列式拆分相关
+// 保证每列至少能容纳rows行
+static void lept_shredder_reserve(lept_shredder* s, size_t rows);
+static int lept_shred_record(lept_shredder* s, const char* end);
+// 在对象中匹配前count个候选列
+static int lept_shred_object(lept_shredder* s, const char* end, size_t count);
+static int lept_shred_value(lept_shredder* s, lept_column* col);
+
+// 释放文档或子树句柄本身的一个引用
+static void lept_doc_free(lept_doc* doc);
+
+// 估算一棵树占用的堆内存
+static size_t lept_value_memory(const lept_value* v);
+#endif
+
 #endif
@@ -0,0 +1,430 @@
+#include <stdio.h>
+#include <stdlib.h> /* malloc */
+#include <string.h> /* strlen */
+#include <time.h> /* clock_gettime */
+#include <unistd.h> /* sysconf */
+#include "leptjson.h"
+
+// 返回单调时钟的秒数
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// 生成包含records条记录的测试文档，返回值需要free
+static char* make_document(size_t records) {
+    size_t i, size = records * 160 + 16, len = 0;
+    char* json = (char*)malloc(size);
+    len += sprintf(json + len, "[");
+    for (i = 0; i < records; i++)
+        len += sprintf(json + len,
+            "%s{\"id\":%zu,\"name\":\"user_%zu\",\"score\":%.3f,\"active\":%s,"
+            "\"tags\":[\"a\",\"b\\n\"],\"pos\":[%zu.5,-%zu.25,1e-3]}",
+            i == 0 ? "" : ",", i, i, i * 0.37, i % 2 ? "true" : "false", i, i);
+    sprintf(json + len, "]");
+    return json;
+}
+
+#define BENCH(label, iterations, bytes, statement) \
+    do { \
+        int i_; \
+        double start_ = now(), elapsed_; \
+        for (i_ = 0; i_ < (iterations); i_++) { \
+            statement; \
+        } \
+        elapsed_ = now() - start_; \
+        printf("%-24s %8.2f ms %10.1f MB/s\n", label, elapsed_ * 1e3 / (iterations), \
+            (double)(bytes) * (iterations) / elapsed_ / 1e6); \
+    } while (0)
+
+// 只校验和完整解析的对比
+static void bench_validate(const char* json, size_t len, int iterations) {
+    lept_value v;
+    lept_init(&v);
+    BENCH("lept_parse + lept_free", iterations, len, {
+        lept_parse(&v, json);
+        lept_free(&v);
+    });
+    BENCH("lept_validate", iterations, len, lept_validate(json, len, NULL));
+}
+
+// 生成包含records个长字符串的数组，每隔几条带有非ASCII字符
+static char* make_string_document(size_t records) {
+    size_t i, len = 0;
+    char* json = (char*)malloc(records * 200 + 16);
+    len += sprintf(json + len, "[");
+    for (i = 0; i < records; i++)
+        len += sprintf(json + len, "%s\"%s lorem ipsum dolor sit amet, consectetur adipiscing elit, "
+            "sed do eiusmod tempor incididunt ut labore et dolore magna aliqua %zu\"",
+            i == 0 ? "" : ",", i % 4 ? "plain" : "\xE4\xBD\xA0\xE5\xA5\xBD", i);
+    sprintf(json + len, "]");
+    return json;
+}
+
+// 字符串扫描以及严格UTF-8校验的开销
+static void bench_utf8(size_t records, int iterations) {
+    char* json = make_string_document(records);
+    size_t len = strlen(json);
+    lept_value v;
+    lept_init(&v);
+    printf("string document: %.1f MB\n", len / 1e6);
+    BENCH("lept_parse", iterations, len, {
+        lept_parse(&v, json);
+        lept_free(&v);
+    });
+    BENCH("lept_parse strict utf8", iterations, len, {
+        lept_parse_ex(&v, json, LEPT_PARSE_VALIDATE_UTF8);
+        lept_free(&v);
+    });
+    free(json);
+}
+
+// 生成长度为count的数字数组
+static char* make_number_document(size_t count) {
+    size_t i, len = 0;
+    char* json = (char*)malloc(count * 24 + 16);
+    len += sprintf(json + len, "[");
+    for (i = 0; i < count; i++)
+        len += sprintf(json + len, "%s%.6f", i == 0 ? "" : ",", i * 0.001 - 17.5);
+    sprintf(json + len, "]");
+    return json;
+}
+
+// 数字数组的普通存储与紧凑存储：解析速度、求和速度与内存
+static void bench_packed(size_t count, int iterations) {
+    char* json = make_number_document(count);
+    size_t i, len = strlen(json);
+    double sum = 0.0;
+    lept_value v, packed;
+    lept_init(&v);
+    lept_init(&packed);
+    printf("number array: %zu numbers, %.1f MB\n", count, len / 1e6);
+    BENCH("lept_parse", iterations, len, {
+        lept_parse(&v, json);
+        lept_free(&v);
+    });
+    BENCH("lept_parse packed", iterations, len, {
+        lept_parse_ex(&v, json, LEPT_PARSE_PACK_NUMBERS);
+        lept_free(&v);
+    });
+    lept_parse(&v, json);
+    lept_parse_ex(&packed, json, LEPT_PARSE_PACK_NUMBERS);
+    printf("memory: %zu bytes vs %zu bytes packed\n", count * sizeof(lept_value), count * sizeof(double));
+    BENCH("sum elements", iterations, count * sizeof(double), {
+        for (i = 0; i < count; i++)
+            sum += lept_get_number(lept_get_array_element(&v, i));
+    });
+    BENCH("sum packed", iterations, count * sizeof(double), {
+        const double* numbers = lept_get_number_array(&packed, NULL);
+        for (i = 0; i < count; i++)
+            sum += numbers[i];
+    });
+    printf("(checksum %g)\n", sum);
+    lept_free(&v);
+    lept_free(&packed);
+    free(json);
+}
+
+// 遍历整棵树，统计节点占用的内存
+static double traverse(const lept_value* v, size_t* memory) {
+    size_t i;
+    double sum = 0.0;
+    switch (lept_get_type(v)) {
+        case LEPT_NUMBER:
+            return lept_get_number(v);
+        case LEPT_STRING:
+            *memory += lept_get_string_length(v) + 1;
+            return (double)lept_get_string_length(v);
+        case LEPT_ARRAY:
+            *memory += lept_get_array_size(v) * sizeof(lept_value);
+            for (i = 0; i < lept_get_array_size(v); i++)
+                sum += traverse(lept_get_array_element(v, i), memory);
+            return sum;
+        case LEPT_OBJECT:
+            *memory += lept_get_object_size(v) * sizeof(lept_member);
+            for (i = 0; i < lept_get_object_size(v); i++) {
+                *memory += lept_get_object_key_length(v, i) + 1;
+                sum += traverse(lept_get_object_value(v, i), memory);
+            }
+            return sum;
+        default:
+            return 0.0;
+    }
+}
+
+// 统计输出字节数，不保存内容
+static size_t count_write(void* ctx, const char* data, size_t len) {
+    (void)data;
+    *(size_t*)ctx += len;
+    return len;
+}
+
+typedef struct {
+    char* buf;
+    size_t len, cap;
+} bench_output;
+
+// 把输出追加到内存中
+static size_t append_write(void* ctx, const char* data, size_t len) {
+    bench_output* out = (bench_output*)ctx;
+    if (out->len + len > out->cap) {
+        out->cap = (out->len + len) * 2;
+        out->buf = (char*)realloc(out->buf, out->cap);
+    }
+    memcpy(out->buf + out->len, data, len);
+    out->len += len;
+    return len;
+}
+
+// 流式重新排版与memcpy、只校验的对比
+static void bench_reformat(const char* json, size_t len, int iterations) {
+    size_t out = 0;
+    bench_output pretty = { NULL, 0, 0 };
+    char* copy = (char*)malloc(len);
+    BENCH("memcpy", iterations, len, memcpy(copy, json, len));
+    out += (size_t)copy[len / 2];
+    free(copy);
+    BENCH("lept_reformat minify", iterations, len, lept_reformat(json, len, 0, count_write, &out));
+    BENCH("lept_reformat indent 2", iterations, len, lept_reformat(json, len, 2, count_write, &out));
+    // 缩进后的文档含有大量空白，作为压缩的输入
+    lept_reformat(json, len, 2, append_write, &pretty);
+    printf("pretty document: %.1f MB\n", pretty.len / 1e6);
+    BENCH("lept_validate pretty", iterations, pretty.len, lept_validate(pretty.buf, pretty.len, NULL));
+    BENCH("lept_reformat pretty->min", iterations, pretty.len, lept_reformat(pretty.buf, pretty.len, 0, count_write, &out));
+    printf("(%zu bytes written)\n", out);
+    free(pretty.buf);
+}
+
+// 用lept_writer直接写出与make_document相同结构的记录
+static size_t write_records(size_t records) {
+    char buf[16384], name[32];
+    size_t i, out = 0;
+    lept_writer w;
+    lept_writer_init(&w, buf, sizeof(buf), count_write, &out);
+    lept_writer_begin_array(&w);
+    for (i = 0; i < records; i++) {
+        lept_writer_begin_object(&w);
+        lept_writer_key(&w, "id", 2);
+        lept_writer_int(&w, (int64_t)i);
+        lept_writer_key(&w, "name", 4);
+        lept_writer_string(&w, name, (size_t)sprintf(name, "user_%zu", i));
+        lept_writer_key(&w, "score", 5);
+        lept_writer_number(&w, i * 0.37);
+        lept_writer_key(&w, "active", 6);
+        lept_writer_boolean(&w, i % 2);
+        lept_writer_key(&w, "tags", 4);
+        lept_writer_begin_array(&w);
+        lept_writer_string(&w, "a", 1);
+        lept_writer_string(&w, "b\n", 2);
+        lept_writer_end_array(&w);
+        lept_writer_end_object(&w);
+    }
+    lept_writer_end_array(&w);
+    lept_writer_finish(&w);
+    return out;
+}
+
+// 写出整棵树，返回输出的字节数
+static size_t write_tree(const lept_value* v) {
+    char buf[16384];
+    size_t out = 0;
+    lept_writer w;
+    lept_writer_init(&w, buf, sizeof(buf), count_write, &out);
+    lept_writer_value(&w, v);
+    lept_writer_finish(&w);
+    return out;
+}
+
+// 流式写出记录，以及写出已有的树
+static void bench_writer(const char* json, size_t records, int iterations) {
+    size_t bytes = write_records(records);
+    lept_value v;
+    lept_init(&v);
+    BENCH("lept_writer records", iterations, bytes, write_records(records));
+    lept_parse(&v, json);
+    bytes = write_tree(&v);
+    BENCH("lept_writer_value", iterations, bytes, write_tree(&v));
+    lept_free(&v);
+}
+
+// 共享冻结的文档与每次深拷贝的对比
+static void bench_doc(const char* json, size_t len, int iterations) {
+    lept_value v, copy;
+    lept_doc* doc;
+    lept_init(&v);
+    lept_init(&copy);
+    lept_parse(&v, json);
+    doc = lept_freeze(&v);
+    BENCH("lept_copy + lept_free", iterations, len, {
+        lept_copy(&copy, lept_doc_root(doc));
+        lept_free(&copy);
+    });
+    BENCH("lept_doc_retain/release", iterations, len, lept_doc_release(lept_doc_retain(doc)));
+    lept_doc_release(doc);
+}
+
+// 每行一条记录的NDJSON：逐条解析再按键取值与列式拆分的对比
+static void bench_shred(size_t records, int iterations) {
+    lept_column columns[] = {
+        LEPT_COLUMN("/id", LEPT_COLUMN_INT),
+        LEPT_COLUMN("/name", LEPT_COLUMN_STRING),
+        LEPT_COLUMN("/score", LEPT_COLUMN_NUMBER),
+        LEPT_COLUMN("/active", LEPT_COLUMN_BOOL)
+    };
+    lept_shredder s;
+    size_t i, len = 0;
+    double sum = 0.0;
+    char* json = (char*)malloc(records * 160 + 16);
+    char** lines = (char**)malloc(records * sizeof(char*));
+    for (i = 0; i < records; i++) {
+        lines[i] = json + len;
+        len += sprintf(json + len, "{\"id\":%zu,\"name\":\"user_%zu\",\"score\":%.3f,\"active\":%s,"
+            "\"tags\":[\"a\",\"b\"],\"pos\":[%zu.5,1e-3]}\n", i, i, i * 0.37, i % 2 ? "true" : "false", i);
+    }
+    printf("ndjson: %zu records, %.1f MB\n", records, len / 1e6);
+    BENCH("lept_parse per record", iterations, len, {
+        lept_value v;
+        const char* end;
+        lept_init(&v);
+        for (i = 0; i < records; i++) {
+            // lept_parse要求以'\0'结尾，逐行复制后解析
+            char line[160];
+            end = i + 1 < records ? lines[i + 1] : json + len;
+            memcpy(line, lines[i], (size_t)(end - lines[i]));
+            line[end - lines[i]] = '\0';
+            lept_parse(&v, line);
+            sum += lept_get_number(lept_find_object_value(&v, "score", 5));
+            lept_free(&v);
+        }
+    });
+    lept_shredder_init(&s, columns, sizeof(columns) / sizeof(columns[0]));
+    BENCH("lept_shred", iterations, len, {
+        lept_shredder_clear(&s);
+        lept_shred(&s, json);
+        for (i = 0; i < s.rows; i++)
+            sum += columns[2].numbers[i];
+    });
+    printf("(checksum %g)\n", sum);
+    lept_shredder_free(&s);
+    free(lines);
+    free(json);
+}
+
+// 节点布局对内存和遍历速度的影响
+static void bench_traverse(const char* json, size_t len, int iterations) {
+    size_t memory = 0;
+    double sum = 0.0;
+    lept_value v;
+    lept_init(&v);
+    lept_parse(&v, json);
+    traverse(&v, &memory);
+    printf("node layout: sizeof(lept_value) = %zu, sizeof(lept_member) = %zu, tree memory %.1f MB\n",
+        sizeof(lept_value), sizeof(lept_member), memory / 1e6);
+    BENCH("traverse", iterations, len, sum += traverse(&v, &memory));
+    printf("(checksum %g)\n", sum);
+    lept_free(&v);
+}
+
+// 顶层数组并行解析，线程数从1增加到CPU核数(至少4)
+static void bench_parallel(const char* json, size_t len, int iterations) {
+    char label[32];
+    int threads, max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    lept_value v;
+    lept_init(&v);
+    if (max_threads < 4)
+        max_threads = 4;
+    for (threads = 1; threads <= max_threads; threads++) {
+        sprintf(label, "parallel %d threads", threads);
+        BENCH(label, iterations, len, {
+            lept_parse_parallel(&v, json, LEPT_PARSE_DEFAULT, threads);
+            lept_free(&v);
+        });
+    }
+}
+
+typedef struct {
+    int64_t id;
+    char* name;
+    double score;
+    int active;
+} bench_record;
+
+static lept_field bench_record_fields[] = {
+    LEPT_FIELD(bench_record, id, LEPT_FIELD_INT),
+    LEPT_FIELD(bench_record, name, LEPT_FIELD_STRING),
+    LEPT_FIELD(bench_record, score, LEPT_FIELD_NUMBER),
+    LEPT_FIELD(bench_record, active, LEPT_FIELD_BOOL)
+};
+static lept_struct_desc bench_record_desc = LEPT_STRUCT_DESC(bench_record_fields);
+
+// 先解析成lept_value树，再按键复制到结构体
+static void dom_copy(const char* json, bench_record* r) {
+    lept_value v;
+    size_t i;
+    lept_init(&v);
+    if (lept_parse(&v, json) != LEPT_PARSE_OK)
+        return;
+    for (i = 0; i < lept_get_object_size(&v); i++) {
+        const char* key = lept_get_object_key(&v, i);
+        lept_value* e = lept_get_object_value(&v, i);
+        if (strcmp(key, "id") == 0)
+            r->id = (int64_t)lept_get_number(e);
+        else if (strcmp(key, "name") == 0) {
+            free(r->name);
+            r->name = (char*)malloc(lept_get_string_length(e) + 1);
+            memcpy(r->name, lept_get_string(e), lept_get_string_length(e) + 1);
+        }
+        else if (strcmp(key, "score") == 0)
+            r->score = lept_get_number(e);
+        else if (strcmp(key, "active") == 0)
+            r->active = lept_get_boolean(e);
+    }
+    lept_free(&v);
+}
+
+// 固定结构的消息：DOM加复制与直接绑定的对比
+static void bench_bind(size_t count, int iterations) {
+    char** messages = (char**)malloc(count * sizeof(char*));
+    size_t i, bytes = 0;
+    bench_record r;
+    memset(&r, 0, sizeof(r));
+    for (i = 0; i < count; i++) {
+        messages[i] = (char*)malloc(160);
+        bytes += sprintf(messages[i], "{\"id\":%zu,\"name\":\"user_%zu\",\"score\":%.3f,\"active\":%s,"
+            "\"tags\":[\"a\",\"b\"],\"pos\":[%zu.5,1e-3]}", i, i, i * 0.37, i % 2 ? "true" : "false", i);
+    }
+    printf("messages: %zu, %.1f MB\n", count, bytes / 1e6);
+    BENCH("dom + copy", iterations, bytes, {
+        for (i = 0; i < count; i++)
+            dom_copy(messages[i], &r);
+    });
+    BENCH("lept_bind_parse", iterations, bytes, {
+        for (i = 0; i < count; i++)
+            lept_bind_parse(&bench_record_desc, &r, messages[i]);
+    });
+    lept_bind_free(&bench_record_desc, &r);
+    for (i = 0; i < count; i++)
+        free(messages[i]);
+    free(messages);
+}
+
+int main(int argc, char* argv[]) {
+    size_t records = argc > 1 ? (size_t)atol(argv[1]) : 100000;
+    int iterations = argc > 2 ? atoi(argv[2]) : 10;
+    char* json = make_document(records);
+    size_t len = strlen(json);
+    printf("document: %zu records, %.1f MB\n", records, len / 1e6);
+    bench_validate(json, len, iterations);
+    bench_traverse(json, len, iterations);
+    bench_parallel(json, len, iterations);
+    bench_reformat(json, len, iterations);
+    bench_writer(json, records, iterations);
+    bench_doc(json, len, iterations);
+    free(json);
+    bench_utf8(records, iterations);
+    bench_packed(records * 10, iterations);
+    bench_bind(records, iterations);
+    bench_shred(records, iterations);
+    return 0;
+}
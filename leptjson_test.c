@@ -1,5 +1,9 @@
 #include <stdio.h>
+#include <stdlib.h> /* mkstemp */
 #include <string.h> /* memcmp */
+#include <unistd.h> /* write, unlink */
+#include <pthread.h>
+#include <math.h> /* NAN, HUGE_VAL */
 #include "leptjson.h"
 
 static int main_ret = 0; // 整体是否通过
@@ -18,14 +22,14 @@ static int test_pass = 0;
     } while (0)
 
 #define EXPECT_EQ_INT(expect, actual) EXPECT_EQ_BASE((expect) == (actual), expect, actual, "%d")
-#define EXPECT_EQ_DOUBLE(expect, actual) EXPECT_EQ_BASE((expect) == (actual), expect, actual, ".17g")
+#define EXPECT_EQ_DOUBLE(expect, actual) EXPECT_EQ_BASE((expect) == (actual), expect, actual, "%.17g")
 
 #define EXPECT_EQ_STRING(expect, actual, slength) \
     EXPECT_EQ_BASE((sizeof(expect) - 1 == slength && memcmp(expect, actual, slength) == 0), expect, actual, "%s")
-#define EXPECT_EQ_TRUE(actual) EXPECT_EQ_BASE((actual != 0), "true", "false", "%s")
-#define EXPECT_EQ_FALSE(actual) EXPECT_EQ_BASE((actual == 0), "false", "true", "%s")
+#define EXPECT_EQ_TRUE(actual) EXPECT_EQ_BASE((actual) != 0, "true", "false", "%s")
+#define EXPECT_EQ_FALSE(actual) EXPECT_EQ_BASE((actual) == 0, "false", "true", "%s")
 
-#define EXPECT_EQ_SIZE_T(expect, actual) EXPECT_EQ_BASE((expect == actual), (size_t)expect, (size_t)actual, "%zu")
+#define EXPECT_EQ_SIZE_T(expect, actual) EXPECT_EQ_BASE((expect) == (actual), (size_t)(expect), (size_t)(actual), "%zu")
 
 
 // 测试解析null类型
@@ -163,7 +167,7 @@ static void test_parse_array() {
     EXPECT_EQ_SIZE_T(0, lept_get_array_size(lept_get_array_element(&v, 0)));
     EXPECT_EQ_SIZE_T(3, lept_get_array_size(lept_get_array_element(&v, 3)));
     // 查看[ 0 , 1 , 2 ]中的1
-    EXPECT_EQ_DOUBLE(1, lept_get_number(lept_get_array_element(lept_get_array_element(&v, 3), 1)));
+    EXPECT_EQ_DOUBLE(1.0, lept_get_number(lept_get_array_element(lept_get_array_element(&v, 3), 1)));
     lept_free(&v);
 }
 
@@ -175,6 +179,13 @@ static void test_parse_array() {
  */
 
 // 合并错误检测
+// 丢弃输出的回调
+static size_t discard_write(void* ctx, const char* data, size_t len) {
+    (void)ctx;
+    (void)data;
+    return len;
+}
+
 #define TEST_ERROR(error, json) \
     do { \
         lept_value v; \
@@ -182,6 +193,9 @@ static void test_parse_array() {
         v.type = LEPT_FALSE; \
         EXPECT_EQ_INT(error, lept_parse(&v, json)); \
         EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v)); \
+        EXPECT_EQ_INT(error, lept_validate(json, strlen(json), NULL)); \
+        EXPECT_EQ_INT(error, lept_reformat(json, strlen(json), 0, discard_write, NULL)); \
+        EXPECT_EQ_INT(error, lept_reformat(json, strlen(json), 2, discard_write, NULL)); \
     } while (0)
 
 // 测试解析全空类型错误
@@ -335,6 +349,1313 @@ static void test_parse_miss_comma_or_curly_bracket() {
     TEST_ERROR(LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":{}");
 }
 
+#define TEST_EQUAL(json1, json2, equality) \
+    do { \
+        lept_value v1, v2; \
+        lept_init(&v1); \
+        lept_init(&v2); \
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v1, json1)); \
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v2, json2)); \
+        EXPECT_EQ_INT(equality, lept_is_equal(&v1, &v2)); \
+        EXPECT_EQ_INT(equality, lept_is_equal(&v2, &v1)); \
+        if (equality) \
+            EXPECT_EQ_TRUE(lept_hash(&v1) == lept_hash(&v2)); \
+        lept_free(&v1); \
+        lept_free(&v2); \
+    } while (0)
+
+// 写出depth层、每层20个成员的对象，reverse时成员倒序，change不为0时把最后一个叶子加1
+static char* write_wide_object(char* p, int depth, int reverse, int change) {
+    int i, k;
+    *p++ = '{';
+    for (i = 0; i < 20; i++) {
+        k = reverse ? 19 - i : i;
+        p += sprintf(p, "%s\"k%d\":", i == 0 ? "" : ",", k);
+        if (depth > 1)
+            p = write_wide_object(p, depth - 1, reverse, change && k == 19);
+        else
+            p += sprintf(p, "%d", k + (change && k == 19));
+    }
+    *p++ = '}';
+    *p = '\0';
+    return p;
+}
+
+// 多层成员较多的对象，每层的索引叠在同一个缓冲区上
+static void test_equal_nested_wide() {
+    static char json1[131072], json2[131072];
+    write_wide_object(json1, 3, 0, 0);
+    write_wide_object(json2, 3, 1, 0);
+    TEST_EQUAL(json1, json2, 1);
+    write_wide_object(json2, 3, 1, 1);
+    TEST_EQUAL(json1, json2, 0);
+}
+
+static void test_equal() {
+    TEST_EQUAL("true", "true", 1);
+    TEST_EQUAL("true", "false", 0);
+    TEST_EQUAL("false", "false", 1);
+    TEST_EQUAL("null", "null", 1);
+    TEST_EQUAL("null", "0", 0);
+    TEST_EQUAL("123", "123", 1);
+    TEST_EQUAL("123", "456", 0);
+    TEST_EQUAL("0", "-0", 1);
+    TEST_EQUAL("\"abc\"", "\"abc\"", 1);
+    TEST_EQUAL("\"abc\"", "\"abcd\"", 0);
+    TEST_EQUAL("[]", "[]", 1);
+    TEST_EQUAL("[]", "null", 0);
+    TEST_EQUAL("[1,2,3]", "[1,2,3]", 1);
+    TEST_EQUAL("[1,2,3]", "[1,2,3,4]", 0);
+    TEST_EQUAL("[1,2,3]", "[3,2,1]", 0);
+    TEST_EQUAL("[[]]", "[[]]", 1);
+    TEST_EQUAL("{}", "{}", 1);
+    TEST_EQUAL("{}", "null", 0);
+    TEST_EQUAL("{}", "[]", 0);
+    TEST_EQUAL("{\"a\":1,\"b\":2}", "{\"a\":1,\"b\":2}", 1);
+    TEST_EQUAL("{\"a\":1,\"b\":2}", "{\"b\":2,\"a\":1}", 1);
+    TEST_EQUAL("{\"a\":1,\"b\":2}", "{\"a\":1,\"b\":3}", 0);
+    TEST_EQUAL("{\"a\":1,\"b\":2}", "{\"a\":1,\"b\":2,\"c\":3}", 0);
+    TEST_EQUAL("{\"a\":{\"b\":{\"c\":{}}}}", "{\"a\":{\"b\":{\"c\":{}}}}", 1);
+    TEST_EQUAL("{\"a\":{\"b\":{\"c\":{}}}}", "{\"a\":{\"b\":{\"c\":[]}}}", 0);
+    // 重复的键以第一次出现为准
+    TEST_EQUAL("{\"a\":1,\"a\":1}", "{\"a\":1,\"b\":2}", 0);
+    TEST_EQUAL("{\"a\":1,\"a\":2}", "{\"a\":1}", 1);
+    TEST_EQUAL("{\"a\":1,\"a\":2}", "{\"a\":1,\"a\":3}", 1);
+    TEST_EQUAL("{\"a\":1,\"a\":2}", "{\"a\":2,\"a\":1}", 0);
+    TEST_EQUAL("{\"a\":0,\"b\":1,\"c\":2,\"d\":3,\"e\":4,\"f\":5,\"g\":6,\"h\":7,\"i\":8,\"j\":9,"
+               "\"k\":10,\"l\":11,\"m\":12,\"n\":13,\"o\":14,\"p\":15,\"q\":16,\"a\":17}",
+               "{\"q\":16,\"p\":15,\"o\":14,\"n\":13,\"m\":12,\"l\":11,\"k\":10,\"j\":9,"
+               "\"i\":8,\"h\":7,\"g\":6,\"f\":5,\"e\":4,\"d\":3,\"c\":2,\"b\":1,\"a\":0}", 1);
+    TEST_EQUAL("{\"a\":0,\"b\":1,\"c\":2,\"d\":3,\"e\":4,\"f\":5,\"g\":6,\"h\":7,\"i\":8,\"j\":9,"
+               "\"k\":10,\"l\":11,\"m\":12,\"n\":13,\"o\":14,\"p\":15,\"q\":16,\"a\":17}",
+               "{\"q\":16,\"p\":15,\"o\":14,\"n\":13,\"m\":12,\"l\":11,\"k\":10,\"j\":9,"
+               "\"i\":8,\"h\":7,\"g\":6,\"f\":5,\"e\":4,\"d\":3,\"c\":2,\"b\":1,\"r\":0}", 0);
+    // 成员较多时走哈希索引
+    TEST_EQUAL("{\"a\":0,\"b\":1,\"c\":2,\"d\":3,\"e\":4,\"f\":5,\"g\":6,\"h\":7,\"i\":8,\"j\":9,"
+               "\"k\":10,\"l\":11,\"m\":12,\"n\":13,\"o\":14,\"p\":15,\"q\":16,\"r\":17}",
+               "{\"r\":17,\"q\":16,\"p\":15,\"o\":14,\"n\":13,\"m\":12,\"l\":11,\"k\":10,\"j\":9,"
+               "\"i\":8,\"h\":7,\"g\":6,\"f\":5,\"e\":4,\"d\":3,\"c\":2,\"b\":1,\"a\":0}", 1);
+    TEST_EQUAL("{\"a\":0,\"b\":1,\"c\":2,\"d\":3,\"e\":4,\"f\":5,\"g\":6,\"h\":7,\"i\":8,\"j\":9,"
+               "\"k\":10,\"l\":11,\"m\":12,\"n\":13,\"o\":14,\"p\":15,\"q\":16,\"r\":17}",
+               "{\"r\":17,\"q\":16,\"p\":15,\"o\":14,\"n\":13,\"m\":12,\"l\":11,\"k\":10,\"j\":9,"
+               "\"i\":8,\"h\":7,\"g\":6,\"f\":5,\"e\":4,\"d\":3,\"c\":2,\"b\":1,\"z\":0}", 0);
+    test_equal_nested_wide();
+}
+
+static void test_hash() {
+    lept_value v1, v2;
+    lept_init(&v1);
+    lept_init(&v2);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v1, "[1,2]"));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v2, "[2,1]"));
+    EXPECT_EQ_TRUE(lept_hash(&v1) != lept_hash(&v2));
+    lept_free(&v1);
+    lept_free(&v2);
+
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v1, "{\"a\":\"b\"}"));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v2, "{\"b\":\"a\"}"));
+    EXPECT_EQ_TRUE(lept_hash(&v1) != lept_hash(&v2));
+    lept_free(&v1);
+    lept_free(&v2);
+
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v1, "\"\""));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v2, "null"));
+    EXPECT_EQ_TRUE(lept_hash(&v1) != lept_hash(&v2));
+    lept_free(&v1);
+    lept_free(&v2);
+}
+
+#define TEST_CACHE_THREADS 4
+#define TEST_CACHE_LOOKUPS 2000
+
+// 每个线程反复查询少量输入，其中"[0]"最常用，其余的轮流淘汰
+// 持有上一次的结果直到下一次查询之后，读到的值不对时计数，结果写回arg
+static void* cache_worker(void* arg) {
+    lept_cache* cache = *(lept_cache**)arg;
+    const lept_value* prev = NULL;
+    size_t i, k, wrong = 0;
+    char json[16];
+    for (i = 0; i < TEST_CACHE_LOOKUPS; i++) {
+        const lept_value* v;
+        k = i % 3 == 0 ? i / 3 % 8 : 0;
+        sprintf(json, "[%zu]", k);
+        v = lept_cache_parse(cache, json, NULL);
+        if (v == NULL || lept_get_type(v) != LEPT_ARRAY || lept_get_array_size(v) != 1 ||
+            lept_get_number(lept_get_array_element(v, 0)) != (double)k)
+            wrong++;
+        if (prev != NULL && (lept_get_type(prev) != LEPT_ARRAY || lept_get_array_size(prev) != 1))
+            wrong++;
+        if (prev != NULL)
+            lept_cache_release(prev);
+        prev = v;
+    }
+    if (prev != NULL)
+        lept_cache_release(prev);
+    *(size_t*)arg = wrong;
+    return NULL;
+}
+
+static void test_cache_threads() {
+    lept_cache* cache = lept_cache_create(4, 0);
+    lept_cache_stats stats;
+    pthread_t threads[TEST_CACHE_THREADS];
+    union {
+        lept_cache* cache;
+        size_t wrong;
+    } args[TEST_CACHE_THREADS];
+    int i;
+
+    for (i = 0; i < TEST_CACHE_THREADS; i++) {
+        args[i].cache = cache;
+        EXPECT_EQ_INT(0, pthread_create(&threads[i], NULL, cache_worker, &args[i]));
+    }
+    for (i = 0; i < TEST_CACHE_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        EXPECT_EQ_SIZE_T(0, args[i].wrong);
+    }
+    // 每次查询恰好计为一次命中或未命中，条目数不超过上限
+    lept_cache_get_stats(cache, &stats);
+    EXPECT_EQ_SIZE_T(TEST_CACHE_THREADS * TEST_CACHE_LOOKUPS, stats.hits + stats.misses);
+    EXPECT_EQ_TRUE(stats.hits > 0);
+    EXPECT_EQ_TRUE(stats.evictions > 0);
+    EXPECT_EQ_TRUE(stats.entries <= 4);
+    // 同时未命中相同输入时只插入一份，所以不是每次未命中都产生条目
+    EXPECT_EQ_TRUE(stats.entries + stats.evictions <= stats.misses);
+    lept_cache_destroy(cache);
+}
+
+static void test_cache() {
+    lept_cache* cache = lept_cache_create(2, 0);
+    lept_cache_stats stats;
+    const lept_value* v1, * v2, * v3;
+    int ret;
+
+    v1 = lept_cache_parse(cache, "[1, 2, 3]", &ret);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, ret);
+    EXPECT_EQ_INT(LEPT_ARRAY, lept_get_type(v1));
+    EXPECT_EQ_SIZE_T(3, lept_get_array_size(v1));
+    v2 = lept_cache_parse(cache, "[1, 2, 3]", &ret);
+    EXPECT_EQ_TRUE(v1 == v2);
+    lept_cache_release(v2);
+
+    EXPECT_EQ_TRUE(lept_cache_parse(cache, "[1, 2", &ret) == NULL);
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, ret);
+
+    // 容量为2，第三个输入淘汰最久未使用的"[1, 2, 3]"
+    v2 = lept_cache_parse(cache, "\"a\"", NULL);
+    v3 = lept_cache_parse(cache, "{\"b\":true}", NULL);
+    lept_cache_get_stats(cache, &stats);
+    EXPECT_EQ_SIZE_T(1, stats.hits);
+    EXPECT_EQ_SIZE_T(4, stats.misses);
+    EXPECT_EQ_SIZE_T(1, stats.evictions);
+    EXPECT_EQ_SIZE_T(2, stats.entries);
+    // 被淘汰的值在释放前仍然有效
+    EXPECT_EQ_DOUBLE(3.0, lept_get_number(lept_get_array_element(v1, 2)));
+    lept_cache_release(v1);
+    lept_cache_release(v2);
+
+    lept_cache_destroy(cache);
+    EXPECT_EQ_TRUE(lept_get_boolean(lept_get_object_value(v3, 0)));
+    lept_cache_release(v3);
+
+    // 内存上限太小时不缓存
+    cache = lept_cache_create(16, 1);
+    v1 = lept_cache_parse(cache, "null", NULL);
+    lept_cache_get_stats(cache, &stats);
+    EXPECT_EQ_SIZE_T(0, stats.entries);
+    EXPECT_EQ_SIZE_T(0, stats.memory);
+    lept_cache_release(v1);
+    lept_cache_destroy(cache);
+}
+
+// 将内容写入临时文件，path至少能容纳32个字符
+static int write_temp_file(char* path, const char* content, size_t len) {
+    int fd;
+    strcpy(path, "/tmp/leptjson_test_XXXXXX");
+    if ((fd = mkstemp(path)) < 0)
+        return 0;
+    if (write(fd, content, len) != (ssize_t)len) {
+        close(fd);
+        return 0;
+    }
+    close(fd);
+    return 1;
+}
+
+// 将内容写入临时文件后用lept_parse_file解析
+static int parse_temp_file(lept_value* v, const char* content, size_t len) {
+    char path[32];
+    int ret;
+    if (!write_temp_file(path, content, len))
+        return -1;
+    ret = lept_parse_file(v, path, LEPT_PARSE_DEFAULT);
+    unlink(path);
+    return ret;
+}
+
+static void test_parse_file() {
+    lept_value v;
+    char buf[4096];
+    lept_init(&v);
+
+    EXPECT_EQ_INT(LEPT_PARSE_OK, parse_temp_file(&v, "{\"a\":[1,2]}", 11));
+    EXPECT_EQ_INT(LEPT_OBJECT, lept_get_type(&v));
+    EXPECT_EQ_SIZE_T(2, lept_get_array_size(lept_get_object_value(&v, 0)));
+    lept_free(&v);
+
+    EXPECT_EQ_INT(LEPT_PARSE_EXPECT_VALUE, parse_temp_file(&v, "", 0));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_QUOTATION_MARK, parse_temp_file(&v, "\"abc", 4));
+    // 文件中间出现'\0'
+    EXPECT_EQ_INT(LEPT_PARSE_ROOT_NOT_SINGULAR, parse_temp_file(&v, "true\0", 5));
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));
+
+    // 文件长度正好是一页，结尾后面没有'\0'
+    memset(buf, ' ', sizeof(buf));
+    buf[0] = '[';
+    buf[sizeof(buf) - 1] = ']';
+    EXPECT_EQ_INT(LEPT_PARSE_OK, parse_temp_file(&v, buf, sizeof(buf)));
+    EXPECT_EQ_SIZE_T(0, lept_get_array_size(&v));
+    lept_free(&v);
+    buf[sizeof(buf) - 1] = '1';
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, parse_temp_file(&v, buf, sizeof(buf)));
+
+    EXPECT_EQ_INT(LEPT_PARSE_FILE_ERROR, lept_parse_file(&v, "/nonexistent/leptjson.json", LEPT_PARSE_DEFAULT));
+}
+
+// 出错时检查出错位置，成功时offset保持不变
+#define TEST_VALIDATE(error, json, len, expect_offset) \
+    do { \
+        size_t offset = 0; \
+        EXPECT_EQ_INT(error, lept_validate(json, len, &offset)); \
+        EXPECT_EQ_SIZE_T(expect_offset, offset); \
+    } while (0)
+
+static void test_validate() {
+    TEST_VALIDATE(LEPT_PARSE_OK, "null", 4, 0);
+    TEST_VALIDATE(LEPT_PARSE_OK, " [1, -2.5e3, \"a\\u00A2\\uD834\\uDD1E\", {\"k\": [true, false, {}]}] ", 62, 0);
+    TEST_VALIDATE(LEPT_PARSE_OK, "1.7976931348623157e+308", 23, 0);
+    TEST_VALIDATE(LEPT_PARSE_NUMBER_TOO_BIG, "1.7976931348623159e+308", 23, 0);
+    TEST_VALIDATE(LEPT_PARSE_OK, "0.000000000000000000000000000000000000000000000000000000000000000000001", 71, 0);
+    TEST_VALIDATE(LEPT_PARSE_OK, "1797693134862315700000000000000000000000000000000000000000000000000e242", 71, 0);
+    TEST_VALIDATE(LEPT_PARSE_NUMBER_TOO_BIG, "1797693134862315900000000000000000000000000000000000000000000000000e242", 71, 0);
+    TEST_VALIDATE(LEPT_PARSE_NUMBER_TOO_BIG, "[1, 1e309]", 10, 4);
+
+    // 长度之外的内容不参与校验
+    TEST_VALIDATE(LEPT_PARSE_OK, "truex", 4, 0);
+    TEST_VALIDATE(LEPT_PARSE_OK, "123456", 3, 0);
+    TEST_VALIDATE(LEPT_PARSE_INVALID_VALUE, "true", 3, 0);
+    TEST_VALIDATE(LEPT_PARSE_MISS_QUOTATION_MARK, "\"abc\"", 4, 4);
+    TEST_VALIDATE(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "[1]", 2, 2);
+    TEST_VALIDATE(LEPT_PARSE_EXPECT_VALUE, "1", 0, 0);
+    TEST_VALIDATE(LEPT_PARSE_ROOT_NOT_SINGULAR, "1\0", 2, 1);
+
+    TEST_VALIDATE(LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":1 \"b\"}", 11, 7);
+    TEST_VALIDATE(LEPT_PARSE_INVALID_STRING_ESCAPE, "[\"ab\\x\"]", 8, 5);
+    TEST_VALIDATE(LEPT_PARSE_INVALID_VALUE, " [true, nul]", 12, 8);
+}
+
+#define TEST_UTF8(error, json) \
+    do { \
+        lept_value v; \
+        lept_init(&v); \
+        EXPECT_EQ_INT(error, lept_parse_ex(&v, json, LEPT_PARSE_VALIDATE_UTF8)); \
+        lept_free(&v); \
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, json)); \
+        lept_free(&v); \
+    } while (0)
+
+static void test_parse_utf8() {
+    lept_value v;
+    TEST_UTF8(LEPT_PARSE_OK, "\"\xC2\xA2\"");
+    TEST_UTF8(LEPT_PARSE_OK, "\"\xE2\x82\xAC\xED\x9F\xBF\xEE\x80\x80\"");
+    TEST_UTF8(LEPT_PARSE_OK, "\"\xF0\x9D\x84\x9E\xF4\x8F\xBF\xBF\"");
+    TEST_UTF8(LEPT_PARSE_OK, "[\"0123456789abcdefghijklmnopqrstuvwxyz\xE4\xBD\xA0\xE5\xA5\xBD 0123456789abcdefghijklmnopqrstuvwxyz\"]");
+
+    TEST_UTF8(LEPT_PARSE_INVALID_UTF8, "\"\x80\"");
+    TEST_UTF8(LEPT_PARSE_INVALID_UTF8, "\"\xBF\"");
+    TEST_UTF8(LEPT_PARSE_INVALID_UTF8, "\"\xC0\x80\""); /* 过长编码 */
+    TEST_UTF8(LEPT_PARSE_INVALID_UTF8, "\"\xC1\xBF\"");
+    TEST_UTF8(LEPT_PARSE_INVALID_UTF8, "\"\xE0\x9F\xBF\"");
+    TEST_UTF8(LEPT_PARSE_INVALID_UTF8, "\"\xED\xA0\x80\""); /* 代理区 */
+    TEST_UTF8(LEPT_PARSE_INVALID_UTF8, "\"\xF0\x8F\xBF\xBF\"");
+    TEST_UTF8(LEPT_PARSE_INVALID_UTF8, "\"\xF4\x90\x80\x80\""); /* 超过U+10FFFF */
+    TEST_UTF8(LEPT_PARSE_INVALID_UTF8, "\"\xF5\x80\x80\x80\"");
+    TEST_UTF8(LEPT_PARSE_INVALID_UTF8, "\"\xE2\x82\"");
+    TEST_UTF8(LEPT_PARSE_INVALID_UTF8, "{\"0123456789abcdefghijklmnopqrstuvwxyz\xFF\":1}");
+
+    // 截断的序列后面紧跟字符串结尾
+    lept_init(&v);
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_UTF8, lept_parse_ex(&v, "\"\xE2\x82", LEPT_PARSE_VALIDATE_UTF8));
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));
+}
+
+// 长字符串中的转义与控制字符出现在不同位置
+static void test_parse_long_string() {
+    char json[80], expect[80];
+    size_t i;
+    lept_value v;
+    lept_init(&v);
+    for (i = 0; i < 64; i++) {
+        memset(json, 'a', sizeof(json));
+        memset(expect, 'a', sizeof(expect));
+        json[0] = '\"';
+        json[i + 1] = '\\';
+        json[i + 2] = 'n';
+        json[70] = '\"';
+        json[71] = '\0';
+        expect[i] = '\n';
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, json));
+        EXPECT_EQ_SIZE_T(68, lept_get_string_length(&v));
+        EXPECT_EQ_TRUE(memcmp(expect, lept_get_string(&v), 68) == 0);
+        lept_free(&v);
+        json[i + 1] = '\x01';
+        EXPECT_EQ_INT(LEPT_PARSE_INVALID_STRING_CHAR, lept_parse(&v, json));
+        json[i + 1] = '\"';
+        EXPECT_EQ_INT(LEPT_PARSE_ROOT_NOT_SINGULAR, lept_parse(&v, json));
+    }
+}
+
+static void test_parse_packed_array() {
+    lept_value v, u;
+    const double* numbers;
+    size_t size = 0;
+    lept_init(&v);
+    lept_init(&u);
+
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_ex(&v, "[ 1, -2.5, 3e2 ]", LEPT_PARSE_PACK_NUMBERS));
+    EXPECT_EQ_INT(LEPT_ARRAY, lept_get_type(&v));
+    EXPECT_EQ_SIZE_T(3, lept_get_array_size(&v));
+    numbers = lept_get_number_array(&v, &size);
+    EXPECT_EQ_TRUE(numbers != NULL);
+    EXPECT_EQ_SIZE_T(3, size);
+    EXPECT_EQ_DOUBLE(-2.5, numbers[1]);
+    EXPECT_EQ_DOUBLE(300.0, numbers[2]);
+
+    // 与普通存储的数组相等，哈希相同
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&u, "[1,-2.5,300]"));
+    EXPECT_EQ_TRUE(lept_get_number_array(&u, NULL) == NULL);
+    EXPECT_EQ_TRUE(lept_is_equal(&v, &u));
+    EXPECT_EQ_TRUE(lept_hash(&v) == lept_hash(&u));
+    lept_free(&u);
+
+    // 按元素读取数字不会展开
+    EXPECT_EQ_DOUBLE(1.0, lept_get_array_number(&v, 0));
+    EXPECT_EQ_TRUE(lept_get_number_array(&v, NULL) == numbers);
+    // 显式展开后才能取得元素
+    lept_unpack_array(&v);
+    EXPECT_EQ_TRUE(lept_get_number_array(&v, NULL) == NULL);
+    EXPECT_EQ_DOUBLE(300.0, lept_get_number(lept_get_array_element(&v, 2)));
+    EXPECT_EQ_DOUBLE(-2.5, lept_get_array_number(&v, 1));
+    lept_free(&v);
+
+    // 含有其他类型的数组不压缩，内层数字数组压缩
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_ex(&v, "{\"a\":[1,\"x\"],\"b\":[[1,2],[]]}", LEPT_PARSE_PACK_NUMBERS));
+    EXPECT_EQ_TRUE(lept_get_number_array(lept_get_object_value(&v, 0), NULL) == NULL);
+    EXPECT_EQ_TRUE(lept_get_number_array(lept_get_object_value(&v, 1), NULL) == NULL);
+    numbers = lept_get_number_array(lept_get_array_element(lept_get_object_value(&v, 1), 0), &size);
+    EXPECT_EQ_TRUE(numbers != NULL);
+    EXPECT_EQ_SIZE_T(2, size);
+    EXPECT_EQ_DOUBLE(2.0, numbers[1]);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&u, "{\"b\":[[1,2],[]],\"a\":[1,\"x\"]}"));
+    EXPECT_EQ_TRUE(lept_is_equal(&v, &u));
+    EXPECT_EQ_TRUE(lept_hash(&v) == lept_hash(&u));
+    lept_free(&u);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&u, "{\"b\":[[1,3],[]],\"a\":[1,\"x\"]}"));
+    EXPECT_EQ_FALSE(lept_is_equal(&v, &u));
+    lept_free(&u);
+    lept_free(&v);
+
+    TEST_ERROR(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "[1,2");
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, lept_parse_ex(&v, "[1,2", LEPT_PARSE_PACK_NUMBERS));
+}
+
+static void test_node_size() {
+#ifdef LEPT_COMPACT_NODE
+    EXPECT_EQ_SIZE_T(16, sizeof(lept_value));
+    EXPECT_EQ_SIZE_T(32, sizeof(lept_member));
+#else
+    EXPECT_EQ_SIZE_T(24, sizeof(lept_value));
+#endif
+}
+
+// 并行解析的结果和错误码必须与串行解析相同
+static void test_parse_parallel_case(const char* json, int flags) {
+    lept_value expect, actual;
+    int ret, threads;
+    lept_init(&expect);
+    ret = lept_parse_ex(&expect, json, flags);
+    for (threads = 1; threads <= 4; threads++) {
+        lept_init(&actual);
+        EXPECT_EQ_INT(ret, lept_parse_parallel(&actual, json, flags, threads));
+        EXPECT_EQ_TRUE(lept_is_equal(&expect, &actual));
+        if (ret == LEPT_PARSE_OK && lept_get_type(&expect) == LEPT_ARRAY)
+            EXPECT_EQ_INT(lept_get_number_array(&expect, NULL) == NULL, lept_get_number_array(&actual, NULL) == NULL);
+        lept_free(&actual);
+    }
+    lept_free(&expect);
+}
+
+static void test_parse_parallel() {
+    char json[16384], * p;
+    size_t i;
+
+    test_parse_parallel_case("null", 0);
+    test_parse_parallel_case("[1,2,3]", 0);
+    test_parse_parallel_case("{\"a\":[1]}", 0);
+
+    // 元素足够多时才会真正并行
+    p = json;
+    p += sprintf(p, " [ ");
+    for (i = 0; i < 300; i++)
+        p += sprintf(p, "%s{\"k\":\"a,]}\\\"[{\",\"v\":[%zu,{}]}", i == 0 ? "" : " ,\n", i);
+    sprintf(p, " ] ");
+    test_parse_parallel_case(json, 0);
+    test_parse_parallel_case(json, LEPT_PARSE_PACK_NUMBERS);
+
+    p = json;
+    p += sprintf(p, "[");
+    for (i = 0; i < 1000; i++)
+        p += sprintf(p, "%s%zu.5", i == 0 ? "" : ",", i);
+    p += sprintf(p, "]");
+    test_parse_parallel_case(json, 0);
+    test_parse_parallel_case(json, LEPT_PARSE_PACK_NUMBERS);
+
+    // 元素个数刚好够或差一个时，分段边界不在记录位置的整数倍上
+    for (i = 255; i <= 259; i++) {
+        size_t j;
+        p = json;
+        p += sprintf(p, "[");
+        for (j = 0; j < i; j++)
+            p += sprintf(p, "%s[%zu]", j == 0 ? "" : ",", j);
+        sprintf(p, "]");
+        test_parse_parallel_case(json, 0);
+    }
+
+    p = json;
+    p += sprintf(p, "[");
+    for (i = 0; i < 1000; i++)
+        p += sprintf(p, "%s%zu.5", i == 0 ? "" : ",", i);
+    p += sprintf(p, "]");
+
+    // 各种错误
+    p[-1] = ' ';
+    test_parse_parallel_case(json, 0);
+    p[-1] = ']';
+    sprintf(p, " x");
+    test_parse_parallel_case(json, 0);
+    p[-1] = '\0';
+    test_parse_parallel_case(json, 0);
+    json[2000] = '}';
+    test_parse_parallel_case(json, 0);
+    json[2000] = ' ';
+    json[3000] = '?';
+    test_parse_parallel_case(json, 0);
+    json[3000] = '\"';
+    test_parse_parallel_case(json, 0);
+}
+
+// 用游标依次读取，检查每个元素与整体解析的结果相同，返回最后的返回值
+static int cursor_compare(lept_array_cursor* cur, int ret, const char* json) {
+    lept_value whole, elem;
+    size_t i = 0;
+    int whole_ret;
+    lept_init(&whole);
+    lept_init(&elem);
+    whole_ret = lept_parse(&whole, json);
+    if (ret == LEPT_PARSE_OK) {
+        while ((ret = lept_array_cursor_next(cur, &elem)) == LEPT_PARSE_OK) {
+            if (whole_ret == LEPT_PARSE_OK)
+                EXPECT_EQ_TRUE(lept_is_equal(lept_get_array_element(&whole, i), &elem));
+            i++;
+        }
+        // 结束或出错后继续调用返回相同的结果
+        EXPECT_EQ_INT(ret, lept_array_cursor_next(cur, &elem));
+        EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&elem));
+    }
+    if (ret == LEPT_ARRAY_CURSOR_END) {
+        EXPECT_EQ_INT(LEPT_PARSE_OK, whole_ret);
+        EXPECT_EQ_SIZE_T(i, lept_get_array_size(&whole));
+    }
+    else if (ret != LEPT_PARSE_NOT_ARRAY)
+        EXPECT_EQ_INT(whole_ret, ret);
+    lept_free(&whole);
+    lept_array_cursor_close(cur);
+    return ret;
+}
+
+#define TEST_CURSOR(expect, json) \
+    do { \
+        lept_array_cursor cur; \
+        char path[32]; \
+        int ret = lept_array_cursor_open(&cur, json, LEPT_PARSE_DEFAULT); \
+        EXPECT_EQ_INT(expect, cursor_compare(&cur, ret, json)); \
+        if (write_temp_file(path, json, strlen(json))) { \
+            ret = lept_array_cursor_open_file(&cur, path, LEPT_PARSE_DEFAULT); \
+            EXPECT_EQ_INT(expect, cursor_compare(&cur, ret, json)); \
+            unlink(path); \
+        } \
+    } while (0)
+
+static void test_array_cursor() {
+    lept_array_cursor cur;
+    char* json;
+    size_t i, len = 0;
+
+    TEST_CURSOR(LEPT_ARRAY_CURSOR_END, "[]");
+    TEST_CURSOR(LEPT_ARRAY_CURSOR_END, " [ ] ");
+    TEST_CURSOR(LEPT_ARRAY_CURSOR_END, "[1]");
+    TEST_CURSOR(LEPT_ARRAY_CURSOR_END, " [ null , false , true , 123.4 , \"a]\\\"\" , [ 1 ] , { \"a\" : {} } ] \n");
+    TEST_CURSOR(LEPT_PARSE_EXPECT_VALUE, "");
+    TEST_CURSOR(LEPT_PARSE_EXPECT_VALUE, "  ");
+    TEST_CURSOR(LEPT_PARSE_NOT_ARRAY, "{}");
+    TEST_CURSOR(LEPT_PARSE_INVALID_VALUE, "[1,]");
+    TEST_CURSOR(LEPT_PARSE_INVALID_VALUE, "[1,?]");
+    TEST_CURSOR(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "[1");
+    TEST_CURSOR(LEPT_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "[1,2 3]");
+    TEST_CURSOR(LEPT_PARSE_MISS_QUOTATION_MARK, "[1,\"abc");
+    TEST_CURSOR(LEPT_PARSE_ROOT_NOT_SINGULAR, "[1] x");
+    TEST_CURSOR(LEPT_PARSE_ROOT_NOT_SINGULAR, "[] 1");
+
+    // 超过一次读入大小的文档和元素
+    json = (char*)malloc(LEPT_CURSOR_CHUNK * 8);
+    len += sprintf(json + len, "[");
+    for (i = 0; i < 10000; i++)
+        len += sprintf(json + len, "%s%zu.25", i == 0 ? "" : ",", i);
+    len += sprintf(json + len, ",\"");
+    memset(json + len, 'x', LEPT_CURSOR_CHUNK * 3);
+    len += LEPT_CURSOR_CHUNK * 3;
+    len += sprintf(json + len, "\",{\"a\":[1,2,[3]]}]");
+    TEST_CURSOR(LEPT_ARRAY_CURSOR_END, json);
+    free(json);
+
+    EXPECT_EQ_INT(LEPT_PARSE_FILE_ERROR, lept_array_cursor_open_file(&cur, "/nonexistent/leptjson.json", LEPT_PARSE_DEFAULT));
+    lept_array_cursor_close(&cur);
+}
+
+typedef struct {
+    double x, y;
+} test_point;
+
+typedef struct {
+    int64_t id;
+    char* name;
+    double score;
+    int active;
+    test_point pos;
+} test_record;
+
+static lept_field test_point_fields[] = {
+    LEPT_FIELD(test_point, x, LEPT_FIELD_NUMBER),
+    LEPT_FIELD(test_point, y, LEPT_FIELD_NUMBER)
+};
+static lept_struct_desc test_point_desc = LEPT_STRUCT_DESC(test_point_fields);
+
+static lept_field test_record_fields[] = {
+    LEPT_FIELD(test_record, id, LEPT_FIELD_INT),
+    LEPT_FIELD_NAMED(test_record, name, "user name", LEPT_FIELD_STRING),
+    LEPT_FIELD(test_record, score, LEPT_FIELD_NUMBER),
+    LEPT_FIELD(test_record, active, LEPT_FIELD_BOOL),
+    LEPT_FIELD_STRUCT(test_record, pos, test_point_desc)
+};
+static lept_struct_desc test_record_desc = LEPT_STRUCT_DESC(test_record_fields);
+
+#define TEST_BIND_ERROR(error, json) \
+    do { \
+        test_record r; \
+        memset(&r, 0, sizeof(r)); \
+        EXPECT_EQ_INT(error, lept_bind_parse(&test_record_desc, &r, json)); \
+        lept_bind_free(&test_record_desc, &r); \
+    } while (0)
+
+static void test_bind() {
+    test_record r, r2;
+    char* json;
+    size_t len;
+    memset(&r, 0, sizeof(r));
+    memset(&r2, 0, sizeof(r2));
+
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_bind_parse(&test_record_desc, &r,
+        " { \"id\" : 42 , \"extra\" : [1, {\"id\": 7}, \"x\"] , \"user name\" : \"Ann\\n\" ,"
+        " \"score\" : 1.5 , \"active\" : true , \"pos\" : { \"y\" : -2 , \"z\" : null , \"x\" : 3 } } "));
+    EXPECT_EQ_TRUE(r.id == 42);
+    EXPECT_EQ_STRING("Ann\n", r.name, strlen(r.name));
+    EXPECT_EQ_DOUBLE(1.5, r.score);
+    EXPECT_EQ_INT(1, r.active);
+    EXPECT_EQ_DOUBLE(3.0, r.pos.x);
+    EXPECT_EQ_DOUBLE(-2.0, r.pos.y);
+
+    // 写出后再读回得到相同的结构体
+    json = lept_bind_stringify(&test_record_desc, &r, &len);
+    EXPECT_EQ_SIZE_T(strlen(json), len);
+    EXPECT_EQ_STRING("{\"id\":42,\"user name\":\"Ann\\n\",\"score\":1.5,\"active\":true,\"pos\":{\"x\":3,\"y\":-2}}", json, len);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_bind_parse(&test_record_desc, &r2, json));
+    EXPECT_EQ_TRUE(r2.id == 42);
+    EXPECT_EQ_STRING("Ann\n", r2.name, strlen(r2.name));
+    free(json);
+
+    // 重复绑定时覆盖原有的字符串，null保持原值
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_bind_parse(&test_record_desc, &r2, "{\"user name\":\"Bob\",\"score\":null}"));
+    EXPECT_EQ_STRING("Bob", r2.name, strlen(r2.name));
+    EXPECT_EQ_DOUBLE(1.5, r2.score);
+    lept_bind_free(&test_record_desc, &r2);
+    EXPECT_EQ_TRUE(r2.name == NULL);
+
+    // 整数不经过double，超过2^53也不丢失精度
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_bind_parse(&test_record_desc, &r2, "{\"id\":9007199254740993}"));
+    EXPECT_EQ_TRUE(r2.id == 9007199254740993LL);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_bind_parse(&test_record_desc, &r2, "{\"id\":-9223372036854775808}"));
+    EXPECT_EQ_TRUE(r2.id == INT64_MIN);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_bind_parse(&test_record_desc, &r2, "{\"id\":4.2e1}"));
+    EXPECT_EQ_TRUE(r2.id == 42);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_bind_parse(&test_record_desc, &r2, "{\"id\":-0}"));
+    EXPECT_EQ_TRUE(r2.id == 0);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_bind_parse(&test_record_desc, &r2, "{\"id\":9223372036854775807}"));
+    EXPECT_EQ_TRUE(r2.id == INT64_MAX);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_bind_parse(&test_record_desc, &r2, "{\"id\":42}"));
+    json = lept_bind_stringify(&test_record_desc, &r2, &len);
+    EXPECT_EQ_STRING("{\"id\":42,\"user name\":null,\"score\":1.5,\"active\":true,\"pos\":{\"x\":3,\"y\":-2}}", json, len);
+    free(json);
+
+    // NaN和无穷大无法写成JSON
+    r2.score = NAN;
+    EXPECT_EQ_TRUE(lept_bind_stringify(&test_record_desc, &r2, &len) == NULL);
+    EXPECT_EQ_SIZE_T(0, len);
+    r2.score = 1.5;
+    r2.pos.y = -HUGE_VAL;
+    EXPECT_EQ_TRUE(lept_bind_stringify(&test_record_desc, &r2, NULL) == NULL);
+    lept_bind_free(&test_record_desc, &r);
+
+    TEST_BIND_ERROR(LEPT_PARSE_OK, "{}");
+    TEST_BIND_ERROR(LEPT_PARSE_EXPECT_VALUE, " ");
+    TEST_BIND_ERROR(LEPT_PARSE_TYPE_MISMATCH, "[]");
+    TEST_BIND_ERROR(LEPT_PARSE_TYPE_MISMATCH, "{\"id\":\"1\"}");
+    TEST_BIND_ERROR(LEPT_PARSE_TYPE_MISMATCH, "{\"id\":1.5}");
+    TEST_BIND_ERROR(LEPT_PARSE_TYPE_MISMATCH, "{\"id\":1e30}");
+    TEST_BIND_ERROR(LEPT_PARSE_TYPE_MISMATCH, "{\"id\":9223372036854775808}");
+    TEST_BIND_ERROR(LEPT_PARSE_TYPE_MISMATCH, "{\"id\":-9223372036854775809}");
+    TEST_BIND_ERROR(LEPT_PARSE_TYPE_MISMATCH, "{\"id\":123456789012345678901234567890}");
+    TEST_BIND_ERROR(LEPT_PARSE_TYPE_MISMATCH, "{\"id\":123456789012345678901.5}");
+    TEST_BIND_ERROR(LEPT_PARSE_NUMBER_TOO_BIG, "{\"id\":1e400}");
+    TEST_BIND_ERROR(LEPT_PARSE_INVALID_VALUE, "{\"id\":-}");
+    TEST_BIND_ERROR(LEPT_PARSE_INVALID_VALUE, "{\"id\":1.}");
+    TEST_BIND_ERROR(LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"id\":01}");
+    TEST_BIND_ERROR(LEPT_PARSE_TYPE_MISMATCH, "{\"user name\":1}");
+    TEST_BIND_ERROR(LEPT_PARSE_TYPE_MISMATCH, "{\"active\":0}");
+    TEST_BIND_ERROR(LEPT_PARSE_TYPE_MISMATCH, "{\"pos\":[]}");
+    TEST_BIND_ERROR(LEPT_PARSE_TYPE_MISMATCH, "{\"score\":{}}");
+    TEST_BIND_ERROR(LEPT_PARSE_TYPE_MISMATCH, "{\"user name\":\"a\",\"pos\":{\"x\":true}}");
+    TEST_BIND_ERROR(LEPT_PARSE_MISS_KEY, "{1:1}");
+    TEST_BIND_ERROR(LEPT_PARSE_MISS_COLON, "{\"id\" 1}");
+    TEST_BIND_ERROR(LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"id\":1");
+    TEST_BIND_ERROR(LEPT_PARSE_INVALID_VALUE, "{\"other\":[1,?]}");
+    TEST_BIND_ERROR(LEPT_PARSE_ROOT_NOT_SINGULAR, "{} {}");
+}
+#define TEST_MERGE_PATCH(target, patch, result) \
+    do { \
+        lept_value t, p, r; \
+        lept_init(&t); \
+        lept_init(&p); \
+        lept_init(&r); \
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&t, target)); \
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&p, patch)); \
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&r, result)); \
+        lept_merge_patch(&t, &p); \
+        EXPECT_EQ_TRUE(lept_is_equal(&t, &r)); \
+        EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&p)); \
+        lept_free(&t); \
+        lept_free(&r); \
+    } while (0)
+
+// RFC 7386附录中的例子
+static void test_merge_patch() {
+    TEST_MERGE_PATCH("{\"a\":\"b\"}", "{\"a\":\"c\"}", "{\"a\":\"c\"}");
+    TEST_MERGE_PATCH("{\"a\":\"b\"}", "{\"b\":\"c\"}", "{\"a\":\"b\",\"b\":\"c\"}");
+    TEST_MERGE_PATCH("{\"a\":\"b\"}", "{\"a\":null}", "{}");
+    TEST_MERGE_PATCH("{\"a\":\"b\",\"b\":\"c\"}", "{\"a\":null}", "{\"b\":\"c\"}");
+    TEST_MERGE_PATCH("{\"a\":[\"b\"]}", "{\"a\":\"c\"}", "{\"a\":\"c\"}");
+    TEST_MERGE_PATCH("{\"a\":\"c\"}", "{\"a\":[\"b\"]}", "{\"a\":[\"b\"]}");
+    TEST_MERGE_PATCH("{\"a\":{\"b\":\"c\"}}", "{\"a\":{\"b\":\"d\",\"c\":null}}", "{\"a\":{\"b\":\"d\"}}");
+    TEST_MERGE_PATCH("{\"a\":[{\"b\":\"c\"}]}", "{\"a\":[1]}", "{\"a\":[1]}");
+    TEST_MERGE_PATCH("[\"a\",\"b\"]", "[\"c\",\"d\"]", "[\"c\",\"d\"]");
+    TEST_MERGE_PATCH("{\"a\":\"b\"}", "[\"c\"]", "[\"c\"]");
+    TEST_MERGE_PATCH("{\"a\":\"foo\"}", "null", "null");
+    TEST_MERGE_PATCH("{\"a\":\"foo\"}", "\"bar\"", "\"bar\"");
+    TEST_MERGE_PATCH("{\"e\":null}", "{\"a\":1}", "{\"e\":null,\"a\":1}");
+    TEST_MERGE_PATCH("[1,2]", "{\"a\":\"b\",\"c\":null}", "{\"a\":\"b\"}");
+    TEST_MERGE_PATCH("{}", "{\"a\":{\"bb\":{\"ccc\":null}}}", "{\"a\":{\"bb\":{}}}");
+}
+
+// 把输出收集到内存中，写满limit字节后返回写入不足
+typedef struct {
+    char* buf;
+    size_t len, limit;
+} test_output;
+
+static size_t output_write(void* ctx, const char* data, size_t len) {
+    test_output* out = (test_output*)ctx;
+    if (out->len + len > out->limit)
+        len = out->limit - out->len;
+    out->buf = (char*)realloc(out->buf, out->len + len + 1);
+    memcpy(out->buf + out->len, data, len);
+    out->len += len;
+    out->buf[out->len] = '\0';
+    return len;
+}
+
+// 写成紧凑的文本，比较时连对象成员的顺序也要相同
+static char* write_value(const lept_value* v) {
+    test_output out = { NULL, 0, (size_t)-1 };
+    char buf[64];
+    lept_writer w;
+    lept_writer_init(&w, buf, sizeof(buf), output_write, &out);
+    lept_writer_value(&w, v);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_writer_finish(&w));
+    return out.buf;
+}
+
+#define TEST_PATCH(error, target, patch, result) \
+    do { \
+        lept_value t, p, r; \
+        lept_init(&t); \
+        lept_init(&p); \
+        lept_init(&r); \
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&t, target)); \
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&p, patch)); \
+        EXPECT_EQ_INT(error, lept_apply_patch(&t, &p)); \
+        if (error == LEPT_PATCH_OK) { \
+            EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&r, result)); \
+            EXPECT_EQ_TRUE(lept_is_equal(&t, &r)); \
+        } \
+        else { \
+            /* 失败的补丁不改变文档，成员顺序也不变 */ \
+            char* expect; \
+            char* actual; \
+            EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&r, target)); \
+            expect = write_value(&r); \
+            actual = write_value(&t); \
+            EXPECT_EQ_BASE(strcmp(expect, actual) == 0, expect, actual, "%s"); \
+            free(expect); \
+            free(actual); \
+        } \
+        lept_free(&t); \
+        lept_free(&r); \
+    } while (0)
+
+// RFC 6902附录中的例子
+static void test_apply_patch() {
+    TEST_PATCH(LEPT_PATCH_OK, "{\"foo\":\"bar\"}", "[{\"op\":\"add\",\"path\":\"/baz\",\"value\":\"qux\"}]",
+        "{\"baz\":\"qux\",\"foo\":\"bar\"}");
+    TEST_PATCH(LEPT_PATCH_OK, "{\"foo\":[\"bar\",\"baz\"]}", "[{\"op\":\"add\",\"path\":\"/foo/1\",\"value\":\"qux\"}]",
+        "{\"foo\":[\"bar\",\"qux\",\"baz\"]}");
+    TEST_PATCH(LEPT_PATCH_OK, "{\"baz\":\"qux\",\"foo\":\"bar\"}", "[{\"op\":\"remove\",\"path\":\"/baz\"}]",
+        "{\"foo\":\"bar\"}");
+    TEST_PATCH(LEPT_PATCH_OK, "{\"foo\":[\"bar\",\"qux\",\"baz\"]}", "[{\"op\":\"remove\",\"path\":\"/foo/1\"}]",
+        "{\"foo\":[\"bar\",\"baz\"]}");
+    TEST_PATCH(LEPT_PATCH_OK, "{\"baz\":\"qux\",\"foo\":\"bar\"}", "[{\"op\":\"replace\",\"path\":\"/baz\",\"value\":\"boo\"}]",
+        "{\"baz\":\"boo\",\"foo\":\"bar\"}");
+    TEST_PATCH(LEPT_PATCH_OK, "{\"foo\":{\"bar\":\"baz\",\"waldo\":\"fred\"},\"qux\":{\"corge\":\"grault\"}}",
+        "[{\"op\":\"move\",\"from\":\"/foo/waldo\",\"path\":\"/qux/thud\"}]",
+        "{\"foo\":{\"bar\":\"baz\"},\"qux\":{\"corge\":\"grault\",\"thud\":\"fred\"}}");
+    TEST_PATCH(LEPT_PATCH_OK, "{\"foo\":[\"all\",\"grass\",\"cows\",\"eat\"]}",
+        "[{\"op\":\"move\",\"from\":\"/foo/1\",\"path\":\"/foo/3\"}]",
+        "{\"foo\":[\"all\",\"cows\",\"eat\",\"grass\"]}");
+    TEST_PATCH(LEPT_PATCH_OK, "{\"baz\":\"qux\",\"foo\":[\"a\",2,\"c\"]}",
+        "[{\"op\":\"test\",\"path\":\"/baz\",\"value\":\"qux\"},{\"op\":\"test\",\"path\":\"/foo/1\",\"value\":2}]",
+        "{\"baz\":\"qux\",\"foo\":[\"a\",2,\"c\"]}");
+    TEST_PATCH(LEPT_PATCH_TEST_FAILED, "{\"baz\":\"qux\"}", "[{\"op\":\"test\",\"path\":\"/baz\",\"value\":\"bar\"}]", "");
+    TEST_PATCH(LEPT_PATCH_OK, "{\"foo\":\"bar\"}", "[{\"op\":\"add\",\"path\":\"/child\",\"value\":{\"grandchild\":{}}}]",
+        "{\"foo\":\"bar\",\"child\":{\"grandchild\":{}}}");
+    TEST_PATCH(LEPT_PATCH_OK, "{\"foo\":\"bar\"}", "[{\"op\":\"add\",\"path\":\"/baz\",\"value\":\"qux\",\"xyz\":123}]",
+        "{\"foo\":\"bar\",\"baz\":\"qux\"}");
+    TEST_PATCH(LEPT_PATCH_PATH_NOT_FOUND, "{\"foo\":\"bar\"}", "[{\"op\":\"add\",\"path\":\"/baz/bat\",\"value\":\"qux\"}]", "");
+    TEST_PATCH(LEPT_PATCH_OK, "{\"/\":9,\"~1\":10}", "[{\"op\":\"test\",\"path\":\"/~01\",\"value\":10}]",
+        "{\"/\":9,\"~1\":10}");
+    TEST_PATCH(LEPT_PATCH_OK, "{\"/\":9,\"~1\":10}", "[{\"op\":\"add\",\"path\":\"/a~1b~0\",\"value\":1}]",
+        "{\"/\":9,\"~1\":10,\"a/b~\":1}");
+    TEST_PATCH(LEPT_PATCH_TEST_FAILED, "{\"/\":9,\"~1\":10}", "[{\"op\":\"test\",\"path\":\"/~01\",\"value\":\"10\"}]", "");
+    TEST_PATCH(LEPT_PATCH_OK, "{\"foo\":[\"bar\"]}", "[{\"op\":\"add\",\"path\":\"/foo/-\",\"value\":[\"abc\",\"def\"]}]",
+        "{\"foo\":[\"bar\",[\"abc\",\"def\"]]}");
+
+    // 整个文档、copy以及紧凑存储的数组
+    TEST_PATCH(LEPT_PATCH_OK, "{\"a\":1}", "[{\"op\":\"replace\",\"path\":\"\",\"value\":[1]}]", "[1]");
+    TEST_PATCH(LEPT_PATCH_OK, "{\"a\":{\"b\":[1,2]}}", "[{\"op\":\"copy\",\"from\":\"/a\",\"path\":\"/c\"},"
+        "{\"op\":\"add\",\"path\":\"/c/b/0\",\"value\":0}]", "{\"a\":{\"b\":[1,2]},\"c\":{\"b\":[0,1,2]}}");
+    TEST_PATCH(LEPT_PATCH_OK, "[[1,2,3]]", "[{\"op\":\"remove\",\"path\":\"/0/1\"},{\"op\":\"add\",\"path\":\"/0/0\",\"value\":\"x\"}]",
+        "[[\"x\",1,3]]");
+    TEST_PATCH(LEPT_PATCH_OK, "[1]", "[]", "[1]");
+    {
+        lept_value t, c, p, r;
+        lept_init(&t);
+        lept_init(&c);
+        lept_init(&p);
+        lept_init(&r);
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_ex(&t, "[1,2,3]", LEPT_PARSE_PACK_NUMBERS));
+        lept_copy(&c, &t);
+        EXPECT_EQ_TRUE(lept_get_number_array(&c, NULL) != NULL);
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&p, "[{\"op\":\"remove\",\"path\":\"/1\"},{\"op\":\"add\",\"path\":\"/-\",\"value\":\"x\"}]"));
+        EXPECT_EQ_INT(LEPT_PATCH_OK, lept_apply_patch(&t, &p));
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&r, "[1,3,\"x\"]"));
+        EXPECT_EQ_TRUE(lept_is_equal(&t, &r));
+        lept_swap(&t, &c);
+        EXPECT_EQ_SIZE_T(3, lept_get_array_size(&t));
+        EXPECT_EQ_DOUBLE(2.0, lept_get_array_number(&t, 1));
+        lept_free(&t);
+        lept_free(&c);
+        lept_free(&r);
+    }
+
+    TEST_PATCH(LEPT_PATCH_INVALID, "{}", "{}", "");
+    TEST_PATCH(LEPT_PATCH_INVALID, "{}", "[1]", "");
+    TEST_PATCH(LEPT_PATCH_INVALID, "{}", "[{\"op\":\"add\",\"path\":\"/a\"}]", "");
+    TEST_PATCH(LEPT_PATCH_INVALID, "{}", "[{\"op\":\"set\",\"path\":\"/a\",\"value\":1}]", "");
+    TEST_PATCH(LEPT_PATCH_INVALID, "{}", "[{\"op\":\"add\",\"path\":\"a\",\"value\":1}]", "");
+    TEST_PATCH(LEPT_PATCH_INVALID, "{}", "[{\"op\":\"move\",\"path\":\"/a\"}]", "");
+    TEST_PATCH(LEPT_PATCH_INVALID, "{\"a\":{}}", "[{\"op\":\"move\",\"from\":\"/a\",\"path\":\"/a/b\"}]", "");
+    TEST_PATCH(LEPT_PATCH_INVALID, "{}", "[{\"op\":\"add\",\"path\":\"/a~2\",\"value\":1}]", "");
+    TEST_PATCH(LEPT_PATCH_INVALID, "{}", "[{\"op\":\"add\",\"path\":\"/a~\",\"value\":1}]", "");
+    TEST_PATCH(LEPT_PATCH_INVALID, "{\"a~2\":1}", "[{\"op\":\"test\",\"path\":\"/a~2\",\"value\":1}]", "");
+    TEST_PATCH(LEPT_PATCH_INVALID, "{\"a\":{\"b\":1}}", "[{\"op\":\"remove\",\"path\":\"/a~/b\"}]", "");
+    TEST_PATCH(LEPT_PATCH_INVALID, "{\"a\":1}", "[{\"op\":\"copy\",\"from\":\"/~a\",\"path\":\"/b\"}]", "");
+    TEST_PATCH(LEPT_PATCH_PATH_NOT_FOUND, "{}", "[{\"op\":\"remove\",\"path\":\"/a\"}]", "");
+    TEST_PATCH(LEPT_PATCH_PATH_NOT_FOUND, "{}", "[{\"op\":\"replace\",\"path\":\"/a\",\"value\":1}]", "");
+    TEST_PATCH(LEPT_PATCH_PATH_NOT_FOUND, "[1]", "[{\"op\":\"add\",\"path\":\"/2\",\"value\":1}]", "");
+    TEST_PATCH(LEPT_PATCH_PATH_NOT_FOUND, "[1]", "[{\"op\":\"add\",\"path\":\"/01\",\"value\":1}]", "");
+    TEST_PATCH(LEPT_PATCH_PATH_NOT_FOUND, "[1]", "[{\"op\":\"remove\",\"path\":\"/-\"}]", "");
+    TEST_PATCH(LEPT_PATCH_PATH_NOT_FOUND, "1", "[{\"op\":\"add\",\"path\":\"/a\",\"value\":1}]", "");
+
+    // 出错时撤销之前已经执行的操作
+    TEST_PATCH(LEPT_PATCH_TEST_FAILED, "{\"a\":1}",
+        "[{\"op\":\"add\",\"path\":\"/b\",\"value\":2},{\"op\":\"test\",\"path\":\"/a\",\"value\":5}]", "");
+    TEST_PATCH(LEPT_PATCH_PATH_NOT_FOUND, "{\"a\":1,\"b\":[1,{\"c\":\"x\"},3],\"d\":true}",
+        "[{\"op\":\"remove\",\"path\":\"/a\"},{\"op\":\"replace\",\"path\":\"/b/1/c\",\"value\":\"y\"},"
+        "{\"op\":\"add\",\"path\":\"/b/0\",\"value\":0},{\"op\":\"remove\",\"path\":\"/b/3\"},"
+        "{\"op\":\"add\",\"path\":\"/d\",\"value\":null},{\"op\":\"add\",\"path\":\"/e\",\"value\":{}},"
+        "{\"op\":\"remove\",\"path\":\"/x\"}]", "");
+    TEST_PATCH(LEPT_PATCH_TEST_FAILED, "{\"a\":{\"b\":1},\"c\":[2,3],\"d\":4}",
+        "[{\"op\":\"move\",\"from\":\"/a\",\"path\":\"/c/1\"},{\"op\":\"move\",\"from\":\"/d\",\"path\":\"/c/0\"},"
+        "{\"op\":\"copy\",\"from\":\"/c\",\"path\":\"/f\"},{\"op\":\"move\",\"from\":\"/f\",\"path\":\"/c\"},"
+        "{\"op\":\"test\",\"path\":\"/c/0\",\"value\":0}]", "");
+    TEST_PATCH(LEPT_PATCH_PATH_NOT_FOUND, "{\"a\":1,\"b\":2}",
+        "[{\"op\":\"move\",\"from\":\"/a\",\"path\":\"/x/y\"}]", "");
+    TEST_PATCH(LEPT_PATCH_INVALID, "[1,2]",
+        "[{\"op\":\"replace\",\"path\":\"\",\"value\":{}},{\"op\":\"remove\",\"path\":\"\"},{\"op\":\"bad\"}]", "");
+    TEST_PATCH(LEPT_PATCH_TEST_FAILED, "{\"a\":[1]}",
+        "[{\"op\":\"move\",\"from\":\"\",\"path\":\"\"},{\"op\":\"test\",\"path\":\"/a\",\"value\":[]}]", "");
+    {
+        // 回滚后紧凑存储的数组恢复原样
+        lept_value t, p;
+        lept_init(&t);
+        lept_init(&p);
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_ex(&t, "{\"a\":[1,2,3],\"b\":[4,5]}", LEPT_PARSE_PACK_NUMBERS));
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&p, "[{\"op\":\"remove\",\"path\":\"/a/0\"},{\"op\":\"replace\",\"path\":\"/b/1\",\"value\":\"x\"},"
+            "{\"op\":\"test\",\"path\":\"/a/0\",\"value\":1}]"));
+        EXPECT_EQ_INT(LEPT_PATCH_TEST_FAILED, lept_apply_patch(&t, &p));
+        EXPECT_EQ_TRUE(lept_get_number_array(lept_get_object_value(&t, 0), NULL) != NULL);
+        EXPECT_EQ_TRUE(lept_get_number_array(lept_get_object_value(&t, 1), NULL) != NULL);
+        EXPECT_EQ_DOUBLE(5.0, lept_get_array_number(lept_get_object_value(&t, 1), 1));
+        EXPECT_EQ_SIZE_T(3, lept_get_array_size(lept_get_object_value(&t, 0)));
+        lept_free(&t);
+    }
+}
+
+#define TEST_DIFF(from, to, count) \
+    do { \
+        lept_value f, t, p; \
+        lept_init(&f); \
+        lept_init(&t); \
+        lept_init(&p); \
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&f, from)); \
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&t, to)); \
+        lept_diff(&f, &t, &p); \
+        EXPECT_EQ_SIZE_T((size_t)(count), lept_get_array_size(&p)); \
+        EXPECT_EQ_INT(LEPT_PATCH_OK, lept_apply_patch(&f, &p)); \
+        EXPECT_EQ_TRUE(lept_is_equal(&f, &t)); \
+        lept_free(&f); \
+        lept_free(&t); \
+    } while (0)
+
+// 生成的补丁应用到from上得到to
+static void test_diff() {
+    TEST_DIFF("null", "null", 0);
+    TEST_DIFF("1", "2", 1);
+    TEST_DIFF("{\"a\":1}", "[1]", 1);
+    TEST_DIFF("{\"a\":1,\"b\":2}", "{\"b\":2,\"a\":1}", 0);
+    TEST_DIFF("{\"a\":1,\"b\":2}", "{\"b\":3,\"c\":4}", 3);
+    TEST_DIFF("{\"a\":{\"b\":{\"c\":1,\"d\":2}}}", "{\"a\":{\"b\":{\"c\":1,\"d\":3}}}", 1);
+    TEST_DIFF("{\"a/b\":1,\"~\":2}", "{\"a/b\":2}", 2);
+    TEST_DIFF("[1,2,3,4]", "[1,5]", 3);
+    TEST_DIFF("[1,2]", "[0,2,3,4]", 3);
+    TEST_DIFF("[]", "[[],{}]", 2);
+    TEST_DIFF("{\"x\":[{\"a\":1},{\"b\":[1,2]}]}", "{\"x\":[{\"a\":1},{\"b\":[1]}],\"y\":null}", 2);
+    // 两端插入或删除只生成一个操作
+    TEST_DIFF("[1,2,3,4,5,6,7,8]", "[0,1,2,3,4,5,6,7,8]", 1);
+    TEST_DIFF("[1,2,3,4,5,6,7,8]", "[2,3,4,5,6,7,8]", 1);
+    TEST_DIFF("[1,2,3,4,5,6,7,8]", "[1,2,3,4,5,6,7,8,9]", 1);
+    TEST_DIFF("[1,2,3,4,5,6,7,8]", "[1,2,3,4,5,6,7]", 1);
+    TEST_DIFF("[1,2,3,4,5,6,7,8]", "[1,2,3,0,4,5,6,7,8]", 1);
+    TEST_DIFF("[1,1,1]", "[1,1]", 1);
+    TEST_DIFF("[1,2,1]", "[1,3,3,1]", 2);
+    TEST_DIFF("[[1,2],[3]]", "[[1,2],[4]]", 1);
+    {
+        // 成员较多的对象走哈希索引，深处的一个改动只生成一个操作
+        static char json1[131072], json2[131072];
+        write_wide_object(json1, 3, 0, 0);
+        write_wide_object(json2, 3, 1, 1);
+        TEST_DIFF(json1, json2, 1);
+        TEST_DIFF(json1, json1, 0);
+        TEST_DIFF("{\"a\":1,\"a\":2,\"k0\":0,\"k1\":1,\"k2\":2,\"k3\":3,\"k4\":4,\"k5\":5,\"k6\":6,\"k7\":7,"
+                  "\"k8\":8,\"k9\":9,\"k10\":10,\"k11\":11,\"k12\":12,\"k13\":13,\"k14\":14,\"k15\":15}",
+                  "{\"k15\":15,\"k14\":14,\"k13\":13,\"k12\":12,\"k11\":11,\"k10\":10,\"k9\":9,\"k8\":8,"
+                  "\"k7\":7,\"k6\":6,\"k5\":5,\"k4\":4,\"k3\":3,\"k2\":2,\"k1\":1,\"k0\":0,\"b\":2,\"a\":3}", 2);
+    }
+    {
+        // 紧凑存储的数组只读取，不会被展开
+        lept_value f, t, p;
+        lept_init(&f);
+        lept_init(&t);
+        lept_init(&p);
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_ex(&f, "[1,2,3,4,5,6,7,8]", LEPT_PARSE_PACK_NUMBERS));
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_ex(&t, "[0,1,2,3,4,5,6,7,8]", LEPT_PARSE_PACK_NUMBERS));
+        lept_diff(&f, &t, &p);
+        EXPECT_EQ_SIZE_T(1, lept_get_array_size(&p));
+        EXPECT_EQ_TRUE(lept_get_number_array(&f, NULL) != NULL);
+        EXPECT_EQ_TRUE(lept_get_number_array(&t, NULL) != NULL);
+        EXPECT_EQ_INT(LEPT_PATCH_OK, lept_apply_patch(&f, &p));
+        EXPECT_EQ_TRUE(lept_is_equal(&f, &t));
+        lept_free(&f);
+        lept_free(&t);
+    }
+}
+
+#define TEST_REFORMAT(expect, json, indent) \
+    do { \
+        test_output out = { NULL, 0, (size_t)-1 }; \
+        EXPECT_EQ_INT(LEPT_PARSE_OK, lept_reformat(json, strlen(json), indent, output_write, &out)); \
+        EXPECT_EQ_STRING(expect, out.buf, out.len); \
+        free(out.buf); \
+    } while (0)
+
+static void test_reformat() {
+    static const char pretty[] = "{\n  \"a\": [\n    1,\n    \"x\\\"y\"\n  ],\n  \"b\": {},\n  \"c\": [],\n"
+        "  \"d\": {\n    \"e\": null\n  }\n}";
+    test_output out = { NULL, 0, (size_t)-1 };
+    char path[32], buf[100000];
+    size_t i, len;
+
+    TEST_REFORMAT("null", " null ", 0);
+    TEST_REFORMAT("-1.5e+10", "-1.5e+10", 2);
+    TEST_REFORMAT("\"a b\\n\\u0041\"", " \"a b\\n\\u0041\" ", 0);
+    TEST_REFORMAT("[]", "[ ]", 0);
+    TEST_REFORMAT("[]", "[ \n ]", 4);
+    TEST_REFORMAT("[1,[2,[]],{}]", " [ 1 , [ 2 , [ ] ] , { } ] ", 0);
+    TEST_REFORMAT("{\"a\":[1,\"x\\\"y\"],\"b\":{},\"c\":[],\"d\":{\"e\":null}}", pretty, 0);
+    TEST_REFORMAT(pretty, "{\"a\":[1,\"x\\\"y\"],\"b\":{},\"c\":[],\"d\":{\"e\":null}}", 2);
+    TEST_REFORMAT("[\n     1,\n     {\n          \"a\": 2\n     }\n]", "[1,{\"a\":2}]", 5);
+
+    // 深层嵌套与超过输出缓冲区的长字符串
+    len = 0;
+    for (i = 0; i < 1000; i++)
+        buf[len++] = '[';
+    for (i = 0; i < 1000; i++)
+        buf[len++] = ']';
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_reformat(buf, len, 0, output_write, &out));
+    EXPECT_EQ_TRUE(out.len == len && memcmp(out.buf, buf, len) == 0);
+    out.len = 0;
+    buf[0] = '\"';
+    memset(buf + 1, 'a', sizeof(buf) - 2);
+    buf[sizeof(buf) - 1] = '\"';
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_reformat(buf, sizeof(buf), 2, output_write, &out));
+    EXPECT_EQ_TRUE(out.len == sizeof(buf) && memcmp(out.buf, buf, sizeof(buf)) == 0);
+    out.len = 0;
+
+    // 回调写入不足
+    out.limit = 3;
+    EXPECT_EQ_INT(LEPT_PARSE_WRITE_ERROR, lept_reformat("[1, 2]", 6, 0, output_write, &out));
+    out.len = 0;
+    out.limit = (size_t)-1;
+
+    // 文件输入，不要求以'\0'结尾
+    EXPECT_EQ_TRUE(write_temp_file(path, "{ \"k\" : [ true ] }", 18));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_reformat_file(path, 0, output_write, &out));
+    EXPECT_EQ_STRING("{\"k\":[true]}", out.buf, out.len);
+    unlink(path);
+    EXPECT_EQ_INT(LEPT_PARSE_FILE_ERROR, lept_reformat_file("/nonexistent/leptjson.json", 0, output_write, &out));
+    free(out.buf);
+}
+
+static void test_writer() {
+    test_output out = { NULL, 0, (size_t)-1 };
+    lept_writer w;
+    lept_value v, v2;
+    char buf[64], big[1000];
+    size_t i;
+
+    // 缓冲区很小，写出过程中会多次调用回调
+    lept_writer_init(&w, buf, sizeof(buf), output_write, &out);
+    lept_writer_begin_object(&w);
+    lept_writer_key(&w, "id", 2);
+    lept_writer_int(&w, -9007199254740993LL);
+    lept_writer_key(&w, "name", 4);
+    lept_writer_string(&w, "a\"b\\c\n\x01", 7);
+    lept_writer_key(&w, "list", 4);
+    lept_writer_begin_array(&w);
+    lept_writer_number(&w, 1.5);
+    lept_writer_boolean(&w, 1);
+    lept_writer_boolean(&w, 0);
+    lept_writer_null(&w);
+    lept_writer_begin_array(&w);
+    lept_writer_end_array(&w);
+    lept_writer_begin_object(&w);
+    lept_writer_end_object(&w);
+    lept_writer_end_array(&w);
+    lept_writer_key(&w, "", 0);
+    lept_writer_string(&w, "", 0);
+    lept_writer_end_object(&w);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_writer_finish(&w));
+    EXPECT_EQ_STRING("{\"id\":-9007199254740993,\"name\":\"a\\\"b\\\\c\\n\\u0001\",\"list\":[1.5,true,false,null,[],{}],\"\":\"\"}",
+        out.buf, out.len);
+
+    // 写出整棵树再读回
+    out.len = 0;
+    lept_init(&v);
+    lept_init(&v2);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, "{\"a\":[1,2,{\"b\":\"\\u00e9\\t\"}],\"c\":[],\"d\":-0.1,\"e\":1e300}"));
+    lept_writer_init(&w, buf, sizeof(buf), output_write, &out);
+    lept_writer_value(&w, &v);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_writer_finish(&w));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v2, out.buf));
+    EXPECT_EQ_TRUE(lept_is_equal(&v, &v2));
+    lept_free(&v);
+    lept_free(&v2);
+
+    // 紧凑存储的数组
+    out.len = 0;
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_ex(&v, "[0.25, -3, 1e-7]", LEPT_PARSE_PACK_NUMBERS));
+    lept_writer_init(&w, buf, sizeof(buf), output_write, &out);
+    lept_writer_value(&w, &v);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_writer_finish(&w));
+    EXPECT_EQ_STRING("[0.25,-3,9.9999999999999995e-08]", out.buf, out.len);
+    lept_free(&v);
+
+    // 超过缓冲区的长字符串，转义跨越多次写出
+    out.len = 0;
+    for (i = 0; i < sizeof(big); i++)
+        big[i] = i % 7 == 0 ? '\n' : 'x';
+    lept_writer_init(&w, buf, sizeof(buf), output_write, &out);
+    lept_writer_string(&w, big, sizeof(big));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_writer_finish(&w));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, out.buf));
+    EXPECT_EQ_TRUE(lept_get_string_length(&v) == sizeof(big) && memcmp(lept_get_string(&v), big, sizeof(big)) == 0);
+    lept_free(&v);
+
+    // 回调写入不足
+    out.len = 0;
+    out.limit = 10;
+    lept_writer_init(&w, buf, sizeof(buf), output_write, &out);
+    lept_writer_string(&w, big, sizeof(big));
+    EXPECT_EQ_INT(LEPT_PARSE_WRITE_ERROR, lept_writer_finish(&w));
+
+    // NaN和无穷大无法写成JSON，出错后不再输出
+    out.len = 0;
+    out.limit = (size_t)-1;
+    lept_writer_init(&w, buf, sizeof(buf), output_write, &out);
+    lept_writer_begin_array(&w);
+    lept_writer_number(&w, 1.0);
+    lept_writer_number(&w, NAN);
+    lept_writer_number(&w, 2.0);
+    lept_writer_end_array(&w);
+    EXPECT_EQ_INT(LEPT_PARSE_NOT_FINITE, lept_writer_finish(&w));
+    EXPECT_EQ_SIZE_T(0, out.len);
+    lept_init(&v);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse(&v, "{\"a\":[0]}"));
+    lept_set_number(lept_get_array_element(lept_get_object_value(&v, 0), 0), -HUGE_VAL);
+    lept_writer_init(&w, buf, sizeof(buf), output_write, &out);
+    lept_writer_value(&w, &v);
+    EXPECT_EQ_INT(LEPT_PARSE_NOT_FINITE, lept_writer_finish(&w));
+    EXPECT_EQ_SIZE_T(0, out.len);
+    lept_free(&v);
+    free(out.buf);
+}
+
+#define TEST_DOC_THREADS 4
+
+// 每个线程反复取子树句柄并读取，读取结果写回arg
+static void* doc_reader(void* arg) {
+    lept_doc* doc = *(lept_doc**)arg;
+    const lept_value* list = lept_get_object_value(lept_doc_root(doc), 1);
+    double sum = 0.0;
+    size_t i, j;
+    for (i = 0; i < 1000; i++) {
+        lept_doc* sub = lept_doc_subtree(doc, list);
+        for (j = 0; j < lept_get_array_size(lept_doc_root(sub)); j++)
+            sum += lept_get_array_number(lept_doc_root(sub), j);
+        lept_doc_release(sub);
+    }
+    lept_doc_release(doc);
+    *(double*)arg = sum;
+    return NULL;
+}
+
+static void test_doc() {
+    lept_value v, copy;
+    lept_doc* doc;
+    lept_doc* sub;
+    const lept_value* list;
+    const lept_value* array;
+    pthread_t threads[TEST_DOC_THREADS];
+    union {
+        lept_doc* doc;
+        double sum;
+    } args[TEST_DOC_THREADS];
+    int i;
+
+    lept_init(&v);
+    lept_init(&copy);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_parse_ex(&v, "{\"name\":\"cfg\",\"list\":[1,2,3],\"sub\":{\"a\":[true]}}",
+        LEPT_PARSE_PACK_NUMBERS));
+    doc = lept_freeze(&v);
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));
+    EXPECT_EQ_INT(LEPT_OBJECT, lept_get_type(lept_doc_root(doc)));
+    // 冻结后紧凑存储的数组保持不变，读线程按下标取数字
+    list = lept_get_object_value(lept_doc_root(doc), 1);
+    EXPECT_EQ_TRUE(lept_get_number_array(list, NULL) != NULL);
+
+    // 多个线程同时读取
+    for (i = 0; i < TEST_DOC_THREADS; i++) {
+        args[i].doc = lept_doc_retain(doc);
+        EXPECT_EQ_INT(0, pthread_create(&threads[i], NULL, doc_reader, &args[i]));
+    }
+    for (i = 0; i < TEST_DOC_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        EXPECT_EQ_DOUBLE(6000.0, args[i].sum);
+    }
+
+    // 子树句柄持有整个文档
+    sub = lept_doc_subtree(doc, lept_get_object_value(lept_doc_root(doc), 2));
+    EXPECT_EQ_TRUE(lept_doc_subtree(doc, lept_doc_root(doc)) == doc);
+    lept_doc_release(doc);
+    lept_doc_release(doc);
+    EXPECT_EQ_INT(LEPT_TRUE, lept_get_type(lept_get_array_element(lept_get_object_value(lept_doc_root(sub), 0), 0)));
+
+    // 还有其他引用时复制，唯一引用时直接取出
+    lept_doc_retain(sub);
+    lept_doc_thaw(sub, &copy);
+    EXPECT_EQ_TRUE(lept_is_equal(&copy, lept_doc_root(sub)));
+    EXPECT_EQ_TRUE(lept_get_object_value(&copy, 0) != lept_get_object_value(lept_doc_root(sub), 0));
+    array = lept_doc_root(sub);
+    list = lept_get_object_value(array, 0);
+    lept_doc_thaw(sub, &v);
+    EXPECT_EQ_TRUE(lept_is_equal(&copy, &v));
+    EXPECT_EQ_TRUE(lept_get_object_value(&v, 0) == list);
+    lept_free(&copy);
+    lept_free(&v);
+
+    doc = lept_freeze(&v);
+    lept_doc_thaw(doc, &v);
+    EXPECT_EQ_INT(LEPT_NULL, lept_get_type(&v));
+}
+
+#define EXPECT_COLUMN_STRING(expect, col, row) \
+    EXPECT_EQ_STRING(expect, (col)->chars + (col)->offsets[row], (col)->offsets[(row) + 1] - (col)->offsets[row])
+
+static void test_shred() {
+    lept_column columns[] = {
+        LEPT_COLUMN("/id", LEPT_COLUMN_INT),
+        LEPT_COLUMN("/user/name", LEPT_COLUMN_STRING),
+        LEPT_COLUMN("/user/score", LEPT_COLUMN_NUMBER),
+        LEPT_COLUMN("/active", LEPT_COLUMN_BOOL),
+        LEPT_COLUMN("/a~1b", LEPT_COLUMN_INT)
+    };
+    lept_shredder s;
+    char* batch;
+    size_t i, len;
+    lept_shredder_init(&s, columns, sizeof(columns) / sizeof(columns[0]));
+
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_shred(&s,
+        "{\"id\":9007199254740993,\"user\":{\"name\":\"Ann\",\"score\":1.5},\"active\":true,\"a/b\":1}\n"
+        "\n"
+        "{\"extra\":[1,{\"id\":2}],\"user\":{\"score\":null,\"name\":\"B\\u00e9\\n\"},\"id\":-1e2}\n"
+        "{\"user\":[1],\"active\":false,\"id\":null}\n"
+        "{ \"user\" : { \"name\" : \"\" , \"name\" : \"Dee\" } , \"a\" : { \"b\" : 3 } }"));
+    EXPECT_EQ_SIZE_T(4, s.rows);
+    EXPECT_EQ_TRUE(columns[0].ints[0] == 9007199254740993LL);
+    EXPECT_EQ_TRUE(columns[0].ints[1] == -100);
+    EXPECT_EQ_INT(1, LEPT_COLUMN_IS_VALID(&columns[0], 1));
+    EXPECT_EQ_INT(0, LEPT_COLUMN_IS_VALID(&columns[0], 2));
+    EXPECT_EQ_INT(0, LEPT_COLUMN_IS_VALID(&columns[0], 3));
+    EXPECT_COLUMN_STRING("Ann", &columns[1], 0);
+    EXPECT_COLUMN_STRING("B\xC3\xA9\n", &columns[1], 1);
+    EXPECT_EQ_INT(0, LEPT_COLUMN_IS_VALID(&columns[1], 2));
+    EXPECT_COLUMN_STRING("", &columns[1], 2);
+    EXPECT_EQ_INT(1, LEPT_COLUMN_IS_VALID(&columns[1], 3));
+    EXPECT_COLUMN_STRING("", &columns[1], 3);
+    EXPECT_EQ_SIZE_T(7, columns[1].chars_size);
+    EXPECT_EQ_DOUBLE(1.5, columns[2].numbers[0]);
+    EXPECT_EQ_INT(0, LEPT_COLUMN_IS_VALID(&columns[2], 1));
+    EXPECT_EQ_INT(1, columns[3].bools[0]);
+    EXPECT_EQ_INT(0, columns[3].bools[2]);
+    EXPECT_EQ_INT(1, LEPT_COLUMN_IS_VALID(&columns[3], 2));
+    EXPECT_EQ_INT(0, LEPT_COLUMN_IS_VALID(&columns[3], 1));
+    EXPECT_EQ_TRUE(columns[4].ints[0] == 1);
+    EXPECT_EQ_INT(0, LEPT_COLUMN_IS_VALID(&columns[4], 3));
+
+    // 出错的记录不留下内容
+    EXPECT_EQ_INT(LEPT_PARSE_TYPE_MISMATCH, lept_shred(&s, "{\"user\":{\"name\":\"Eve\"},\"id\":1.5}"));
+    EXPECT_EQ_SIZE_T(4, s.rows);
+    EXPECT_EQ_SIZE_T(7, columns[1].chars_size);
+    EXPECT_EQ_INT(LEPT_PARSE_TYPE_MISMATCH, lept_shred(&s, "{\"id\":\"1\"}"));
+    EXPECT_EQ_INT(LEPT_PARSE_TYPE_MISMATCH, lept_shred(&s, "{\"user\":{\"name\":1}}"));
+    EXPECT_EQ_INT(LEPT_PARSE_TYPE_MISMATCH, lept_shred(&s, "{\"active\":0}"));
+    EXPECT_EQ_INT(LEPT_PARSE_TYPE_MISMATCH, lept_shred(&s, "{\"user\":{\"score\":{}}}"));
+    EXPECT_EQ_INT(LEPT_PARSE_TYPE_MISMATCH, lept_shred(&s, "{\"id\":1e30}"));
+    EXPECT_EQ_INT(LEPT_PARSE_TYPE_MISMATCH, lept_shred(&s, "{\"id\":-9223372036854775809}"));
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_VALUE, lept_shred(&s, "{\"id\":-}"));
+    EXPECT_EQ_INT(LEPT_PARSE_TYPE_MISMATCH, lept_shred(&s, "[]"));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COLON, lept_shred(&s, "{\"id\" 1}"));
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_VALUE, lept_shred(&s, "{\"other\":[1,?]}"));
+    EXPECT_EQ_INT(LEPT_PARSE_MISS_COMMA_OR_CURLY_BRACKET, lept_shred(&s, "{\"id\":1 \"x\":2}"));
+    EXPECT_EQ_SIZE_T(4, s.rows);
+
+    // 重复的键以第一次出现为准，与lept_find_object_value相同，之后的值只校验
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_shred(&s,
+        "{\"id\":1,\"id\":null,\"user\":{\"name\":\"x\",\"name\":\"yz\"}}\n"
+        "{\"id\":null,\"id\":2,\"active\":true,\"active\":\"no\"}\n"
+        "{\"user\":{\"name\":\"p\"},\"user\":{\"name\":\"q\",\"score\":1}}\n"
+        "{\"user\":null,\"user\":{\"name\":\"r\"}}"));
+    EXPECT_EQ_SIZE_T(8, s.rows);
+    EXPECT_EQ_INT(1, LEPT_COLUMN_IS_VALID(&columns[0], 4));
+    EXPECT_EQ_INT(1, (int)columns[0].ints[4]);
+    EXPECT_COLUMN_STRING("x", &columns[1], 4);
+    EXPECT_EQ_INT(0, LEPT_COLUMN_IS_VALID(&columns[0], 5));
+    EXPECT_EQ_INT(1, columns[3].bools[5]);
+    EXPECT_COLUMN_STRING("p", &columns[1], 6);
+    EXPECT_EQ_INT(0, LEPT_COLUMN_IS_VALID(&columns[2], 6));
+    EXPECT_EQ_INT(0, LEPT_COLUMN_IS_VALID(&columns[1], 7));
+    EXPECT_EQ_SIZE_T(9, columns[1].chars_size);
+    EXPECT_EQ_INT(LEPT_PARSE_INVALID_VALUE, lept_shred(&s, "{\"id\":1,\"id\":?}"));
+    EXPECT_EQ_SIZE_T(8, s.rows);
+
+    // 清空后复用缓冲区，多批次追加并扩容
+    lept_shredder_clear(&s);
+    EXPECT_EQ_SIZE_T(0, s.rows);
+    batch = (char*)malloc(1000 * 64);
+    for (i = 0, len = 0; i < 1000; i++)
+        len += (size_t)sprintf(batch + len, "{\"id\":%zu,\"user\":{\"name\":\"u%zu\"}}\n", i, i);
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_shred(&s, batch));
+    EXPECT_EQ_INT(LEPT_PARSE_OK, lept_shred(&s, batch));
+    EXPECT_EQ_SIZE_T(2000, s.rows);
+    for (i = 0; i < 2000; i++) {
+        char name[16];
+        sprintf(name, "u%zu", i % 1000);
+        EXPECT_EQ_TRUE(columns[0].ints[i] == (int64_t)(i % 1000));
+        EXPECT_EQ_TRUE(strlen(name) == columns[1].offsets[i + 1] - columns[1].offsets[i] &&
+            memcmp(name, columns[1].chars + columns[1].offsets[i], strlen(name)) == 0);
+        EXPECT_EQ_INT(0, LEPT_COLUMN_IS_VALID(&columns[2], i));
+    }
+    free(batch);
+    lept_shredder_free(&s);
+}
+
 // 综合测试
 static void test_parse() {
     test_parse_null();
@@ -361,6 +1682,26 @@ static void test_parse() {
     test_parse_miss_key();
     test_parse_miss_colon();
     test_parse_miss_comma_or_curly_bracket();
+    test_equal();
+    test_hash();
+    test_cache();
+    test_cache_threads();
+    test_parse_file();
+    test_validate();
+    test_parse_utf8();
+    test_parse_long_string();
+    test_parse_packed_array();
+    test_node_size();
+    test_parse_parallel();
+    test_array_cursor();
+    test_bind();
+    test_merge_patch();
+    test_apply_patch();
+    test_diff();
+    test_reformat();
+    test_writer();
+    test_doc();
+    test_shred();
 }
 
 int main() {